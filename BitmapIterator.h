@@ -1,49 +1,156 @@
 #ifndef BITMAPITERATOR_H
 #define BITMAPITERATOR_H
-#include <iostream>
-#include <vector>
-class Bitmap;
-class BitmapIterator{
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+
+/*
+ * Random access iterator over the pixels of a Bitmap, row by row in the same order as
+ * r(x,y), skipping the row padding. Dereferencing gives the first byte of a pixel, add
+ * rmask() and friends to get at the colors.
+ *
+ * The position is kept as a row and column so stepping, jumping and differences are
+ * all constant time, which is what the parallel algorithms need to split the range.
+ * T is uint8_t for BitmapIterator and const uint8_t for ConstBitmapIterator.
+ */
+template<typename T>
+class BasicBitmapIterator{
 public:
-    // Our Constructors
-    BitmapIterator();
-    BitmapIterator(Bitmap*, bool end=false);
-    BitmapIterator(const BitmapIterator&);
-    BitmapIterator(const BitmapIterator&&);
-
-    // Our Operators
-    BitmapIterator& operator=(const BitmapIterator&);
-    uint8_t& operator*(){return *_iterator;}
-    uint8_t* operator->(){return &*_iterator;}
-    BitmapIterator& operator++(){ incWidth(1); _iterator+=_step; return *this;}
-    //BitmapIterator& operator--(){ incWidth(-1);_iterator-=_step; return *this;}
-    BitmapIterator  operator++(int){auto temp = *this; ++*this; return temp;}
-    //BitmapIterator  operator--(int){auto temp = *this; --*this; return temp;}
-    BitmapIterator& operator+=(unsigned int i){ incWidth(i); _iterator+=_step*i; return *this;}
-    //BitmapIterator& operator-=(unsigned int i){ _iterator-=_step*i; return *this;}
-    bool operator!=(const BitmapIterator& rhs)const;
-    bool operator==(const BitmapIterator& rhs)const{return _data == rhs._data;}
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef std::remove_const_t<T>          value_type;
+    typedef std::ptrdiff_t                  difference_type;
+    typedef T*                              pointer;
+    typedef T&                              reference;
+
+    BasicBitmapIterator() = default;
+    /*!
+     * \param first first byte of row 0
+     * \param stride bytes from one row to the next, negative for top down images
+     * \param width pixels per row
+     * \param bpp bytes per pixel
+     * \param index pixel number to start at, width*height for the end
+     */
+    BasicBitmapIterator(T* first, std::ptrdiff_t stride, int32_t width, uint32_t bpp, difference_type index = 0):
+        _first{first}, _stride{stride}, _width{width}, _bpp{bpp}
+    {
+        seek(index);
+    }
+    // A const iterator can be made from a mutable one, not the other way around
+    template<typename U, typename = std::enable_if_t<std::is_same<const U, T>::value && !std::is_same<U, T>::value>>
+    BasicBitmapIterator(const BasicBitmapIterator<U>& rhs):
+        _first{rhs._first}, _stride{rhs._stride}, _width{rhs._width}, _bpp{rhs._bpp}, _x{rhs._x}, _y{rhs._y}
+    {
+    }
+
+    reference operator*() const{ return _first[_y*_stride + std::ptrdiff_t(_x)*_bpp]; }
+    pointer   operator->() const{ return &**this; }
+    reference operator[](difference_type n) const{ return *(*this + n); }
+
+    BasicBitmapIterator& operator++(){ if( ++_x == _width ){ _x = 0; ++_y; } return *this; }
+    BasicBitmapIterator& operator--(){ if( _x-- == 0 ){ _x = _width - 1; --_y; } return *this; }
+    BasicBitmapIterator  operator++(int){ auto temp = *this; ++*this; return temp; }
+    BasicBitmapIterator  operator--(int){ auto temp = *this; --*this; return temp; }
+    BasicBitmapIterator& operator+=(difference_type n){ seek(index() + n); return *this; }
+    BasicBitmapIterator& operator-=(difference_type n){ seek(index() - n); return *this; }
+
+    friend BasicBitmapIterator operator+(BasicBitmapIterator it, difference_type n){ return it += n; }
+    friend BasicBitmapIterator operator+(difference_type n, BasicBitmapIterator it){ return it += n; }
+    friend BasicBitmapIterator operator-(BasicBitmapIterator it, difference_type n){ return it -= n; }
+    friend difference_type operator-(const BasicBitmapIterator& lhs, const BasicBitmapIterator& rhs){
+        return lhs.index() - rhs.index();
+    }
+
+    // Only iterators over the same bitmap can be compared
+    bool operator==(const BasicBitmapIterator& rhs) const{ return _y == rhs._y && _x == rhs._x; }
+    bool operator!=(const BasicBitmapIterator& rhs) const{ return !(*this == rhs); }
+    bool operator< (const BasicBitmapIterator& rhs) const{ return index() <  rhs.index(); }
+    bool operator> (const BasicBitmapIterator& rhs) const{ return index() >  rhs.index(); }
+    bool operator<=(const BasicBitmapIterator& rhs) const{ return index() <= rhs.index(); }
+    bool operator>=(const BasicBitmapIterator& rhs) const{ return index() >= rhs.index(); }
+
+    // Coordinates of the current pixel
+    int32_t x() const{ return _x; }
+    int32_t y() const{ return int32_t(_y); }
 
 private:
-    Bitmap *_data;
+    template<typename U> friend class BasicBitmapIterator;
+
+    T*             _first  = nullptr;
+    std::ptrdiff_t _stride = 0;
+    int32_t        _width  = 0;
+    uint32_t       _bpp    = 0;
+    int32_t        _x      = 0;
+    std::ptrdiff_t _y      = 0;
 
-    decltype(std::vector<uint8_t>().begin()) _iterator;
-    uint32_t _step;
-    int32_t _cwidth{0};
-    void incWidth(uint32_t i);
+    difference_type index() const{ return _y*_width + _x; }
+    void seek(difference_type i){
+        _y = _width ? i / _width : 0;
+        _x = _width ? int32_t(i % _width) : 0;
+    }
 };
 
-template<>
-struct std::iterator_traits<BitmapIterator>{
-    typedef uint8_t*                          type;
-    typedef uint8_t*                          value_type;
-    typedef uint8_t**                         pointer;
-    typedef uint8_t*&                         reference;
-    typedef size_t                            size_type;
-    typedef ptrdiff_t                         difference_type;
-    typedef std::forward_iterator_tag         iterator_category;
-    typedef BitmapIterator                    iterator;
-    typedef BitmapIterator                    const_iterator;
+typedef BasicBitmapIterator<uint8_t>       BitmapIterator;
+typedef BasicBitmapIterator<const uint8_t> ConstBitmapIterator;
+
+/*
+ * Random access iterator over the rows of a Bitmap in the same order as row(y).
+ * Dereferencing gives the first byte of the row, wrap it in a PixelRow to index pixels.
+ */
+template<typename T>
+class BasicRowIterator{
+public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef T*                              value_type;
+    typedef std::ptrdiff_t                  difference_type;
+    typedef T* const*                       pointer;
+    typedef T*                              reference;
+
+    BasicRowIterator() = default;
+    BasicRowIterator(T* row, std::ptrdiff_t stride):_row{row}, _stride{stride}{}
+    template<typename U, typename = std::enable_if_t<std::is_same<const U, T>::value && !std::is_same<U, T>::value>>
+    BasicRowIterator(const BasicRowIterator<U>& rhs):_row{rhs._row}, _stride{rhs._stride}{}
+
+    reference operator*() const{ return _row; }
+    reference operator[](difference_type n) const{ return _row + n*_stride; }
+
+    BasicRowIterator& operator++(){ _row += _stride; return *this; }
+    BasicRowIterator& operator--(){ _row -= _stride; return *this; }
+    BasicRowIterator  operator++(int){ auto temp = *this; ++*this; return temp; }
+    BasicRowIterator  operator--(int){ auto temp = *this; --*this; return temp; }
+    BasicRowIterator& operator+=(difference_type n){ _row += n*_stride; return *this; }
+    BasicRowIterator& operator-=(difference_type n){ _row -= n*_stride; return *this; }
+
+    friend BasicRowIterator operator+(BasicRowIterator it, difference_type n){ return it += n; }
+    friend BasicRowIterator operator+(difference_type n, BasicRowIterator it){ return it += n; }
+    friend BasicRowIterator operator-(BasicRowIterator it, difference_type n){ return it -= n; }
+    friend difference_type operator-(const BasicRowIterator& lhs, const BasicRowIterator& rhs){
+        return lhs._stride ? (lhs._row - rhs._row) / lhs._stride : 0;
+    }
+
+    bool operator==(const BasicRowIterator& rhs) const{ return _row == rhs._row; }
+    bool operator!=(const BasicRowIterator& rhs) const{ return _row != rhs._row; }
+    bool operator< (const BasicRowIterator& rhs) const{ return rhs - *this > 0; }
+    bool operator> (const BasicRowIterator& rhs) const{ return rhs < *this; }
+    bool operator<=(const BasicRowIterator& rhs) const{ return !(rhs < *this); }
+    bool operator>=(const BasicRowIterator& rhs) const{ return !(*this < rhs); }
+
+private:
+    template<typename U> friend class BasicRowIterator;
+
+    T*             _row    = nullptr;
+    std::ptrdiff_t _stride = 0;
+};
+
+typedef BasicRowIterator<uint8_t>       RowIterator;
+typedef BasicRowIterator<const uint8_t> ConstRowIterator;
+
+// begin/end pair so a range of rows can go in a range for
+template<typename IT>
+struct RowRange{
+    IT first, last;
+    IT begin() const{ return first; }
+    IT end() const{ return last; }
 };
 
 #endif // BITMAPITERATOR_H
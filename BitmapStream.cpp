@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <vector>
+#include "BitmapStream.h"
+
+BitmapReader::BitmapReader(const std::string& filename):
+    _in{filename, std::ios::binary},
+    _layout{}
+{
+    if( !_in )
+        throw FileOpenException();
+    _layout.readHeaders(_in);
+}
+
+/*
+ * Builds the strip off to the side and swaps it in once everything has been read
+ */
+void BitmapReader::read(Bitmap& strip, int32_t row, int32_t rows){
+    if( row < 0 || rows <= 0 || row + rows > height() )
+        throw OutOfBoundsException();
+
+    Bitmap b(_layout, true);
+    b.setDimension( width(), topDown() ? -rows : rows );
+
+    _in.seekg( _layout.header.offset + std::streamoff(row)*_layout.rowWidth() );
+    _in.read( reinterpret_cast<char*>(b._bits.data()), b._bits.size() );
+    if( !_in )
+        throw TruncatedFileException();
+
+    swap(strip, move(b));
+}
+
+BitmapWriter::BitmapWriter(const std::string& filename, const Bitmap& layout, int32_t width, int32_t height):
+    _out{filename, std::ios::binary | std::ios::trunc},
+    _layout{}
+{
+    if( !_out )
+        throw FileOpenException();
+    // Only the headers are wanted, copying the layout would drag its pixels along
+    _layout.header     = layout.header;
+    _layout.dibs       = layout.dibs;
+    _layout.colorspace = layout.colorspace;
+    _layout._bpp       = layout._bpp;
+    _layout.setHeaderDimension(width, height);
+    _layout.writeHeaders(_out);
+}
+
+void BitmapWriter::write(const Bitmap& strip, int32_t row, int32_t first, int32_t rows){
+    if( rows < 0 )
+        rows = strip.height() - first;
+    if( strip.width() != _layout.width() || strip._bpp != _layout._bpp )
+        throw IncompatibleSizeException();
+    if( first < 0 || first + rows > strip.height() || row < 0 || row + rows > _layout.height() )
+        throw OutOfBoundsException();
+
+    const uint32_t rowWidth = _layout.rowWidth();
+    _out.seekp( _layout.header.offset + std::streamoff(row)*rowWidth );
+    _out.write( reinterpret_cast<const char*>(strip.data() + size_t(first)*rowWidth), size_t(rows)*rowWidth );
+}
+
+void streamFilter(const std::string& in, const std::string& out, const std::function<void(Bitmap&)>& filter,
+                  int32_t rows, int32_t halo, int32_t align){
+    BitmapReader reader(in);
+    const int32_t h = reader.height();
+    BitmapWriter writer(out, reader.layout(), reader.width(), reader.topDown() ? -h : h);
+
+    rows = std::max( align, (rows + align - 1) / align * align );
+
+    // Band edges counted from the first row of the image, a short band at the end
+    // is merged into the one before it so alignment never splits a block
+    std::vector<int32_t> bounds;
+    const int32_t whole = h - h % align;
+    for( int32_t y = 0; y < whole || y == 0; y += rows ){
+        bounds.push_back(y);
+    }
+    bounds.push_back(h);
+
+    // The first row of a top down image is the last one stored
+    if( reader.topDown() ){
+        for( auto& b: bounds ){
+            b = h - b;
+        }
+        std::reverse(bounds.begin(), bounds.end());
+    }
+
+    Bitmap strip;
+    for( size_t i = 1; i < bounds.size(); ++i ){
+        const int32_t first = bounds[i-1];
+        const int32_t last  = bounds[i];
+        const int32_t top    = std::max( 0, first - halo );
+        const int32_t bottom = std::min( h, last + halo );
+
+        reader.read(strip, top, bottom - top);
+        filter(strip);
+        writer.write(strip, first, first - top, last - first);
+    }
+}
+
+void streamGrayscale(const std::string& in, const std::string& out, int32_t rows){
+    streamFilter(in, out, grayscale, rows);
+}
+
+void streamCellShade(const std::string& in, const std::string& out, int32_t rows){
+    streamFilter(in, out, cellShade, rows);
+}
+
+void streamBinaryGray(const std::string& in, const std::string& out, int32_t isovalue, int32_t rows){
+    streamFilter(in, out, [isovalue](Bitmap& b){ binaryGray(b, isovalue); }, rows);
+}
+
+void streamBlur(const std::string& in, const std::string& out, int32_t radius, int32_t rows){
+    // The kernel reaches radius rows each way
+    streamFilter(in, out, [radius](Bitmap& b){ blur(b, radius); }, rows, radius);
+}
+
+void streamPixelate(const std::string& in, const std::string& out, int32_t block, int32_t rows){
+    // Strips are cut on block boundaries so no block is split
+    streamFilter(in, out, [block](Bitmap& b){ pixelate(b, block); }, rows, 0, block);
+}
+
+/*
+ * scaleDown keeps every other stored row and always produces a bottom up image, so
+ * the strips are cut on even stored rows instead of going through streamFilter.
+ */
+void streamScaleDown(const std::string& in, const std::string& out, int32_t rows){
+    BitmapReader reader(in);
+    const int32_t h = reader.height() >> 1 << 1;
+    BitmapWriter writer(out, reader.layout(), reader.width() >> 1, reader.height() >> 1);
+
+    rows = std::max( 2, rows >> 1 << 1 );
+
+    Bitmap strip;
+    for( int32_t row = 0; row < h; row += rows ){
+        reader.read(strip, row, std::min( rows, h - row ));
+        scaleDown(strip);
+        writer.write(strip, row >> 1);
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef BITMAPSTREAM_H
+#define BITMAPSTREAM_H
+#include <fstream>
+#include <functional>
+#include <string>
+#include "bitmap.h"
+
+/*
+ * Strip (row band) access to bmp files for images too large to hold in memory.
+ *
+ * Rows are addressed in the order they are stored in the file, starting from the
+ * pixel offset in the header. A strip is an ordinary Bitmap holding a band of rows
+ * with the same width, depth and orientation as the file, so the filters in bitmap.h
+ * run on it unchanged.
+ */
+
+// Default number of rows held in memory at a time
+const int32_t STRIPROWS = 256;
+
+class BitmapReader
+{
+public:
+    explicit BitmapReader(const std::string& filename);
+
+    // Headers of the file, holds no pixels
+    const Bitmap& layout() const{ return _layout; }
+    int32_t width() const{ return _layout.width(); }
+    int32_t height() const{ return _layout.height(); }
+    bool    topDown() const{ return _layout.dibs.height < 0; }
+
+    /*!
+     * \brief read loads stored rows [row, row+rows) into a strip
+     * \param strip replaced by a bitmap of rows rows
+     * \param row first stored row to read
+     * \param rows number of rows to read
+     */
+    void read(Bitmap& strip, int32_t row, int32_t rows);
+
+private:
+    std::ifstream _in;
+    Bitmap        _layout;
+};
+
+class BitmapWriter
+{
+public:
+    /*!
+     * \brief BitmapWriter creates the file and writes its headers
+     * \param layout supplies depth and color masks of the output
+     * \param width width of the whole output image
+     * \param height height of the whole output image, negative for top down
+     */
+    BitmapWriter(const std::string& filename, const Bitmap& layout, int32_t width, int32_t height);
+
+    /*!
+     * \brief write stores rows of a strip into the file
+     * \param strip a strip with the width and depth of the output
+     * \param row stored row in the output the first row lands on
+     * \param first first stored row of the strip to write, skips any halo
+     * \param rows number of rows to write, -1 for the rest of the strip
+     */
+    void write(const Bitmap& strip, int32_t row, int32_t first = 0, int32_t rows = -1);
+
+private:
+    std::ofstream _out;
+    Bitmap        _layout;
+};
+
+/*!
+ * \brief streamFilter runs a filter over a file strip by strip
+ * \param filter applied to each strip, must not change its dimensions
+ * \param rows rows per strip, rounded up to a multiple of align
+ * \param halo extra rows read on each side of a strip so neighbourhood filters see
+ *        the same pixels they would in memory, they are not written back
+ * \param align strips start on multiples of align rows counted from the first row of
+ *        the image, any rows left over are joined onto the strip before them
+ */
+void streamFilter(const std::string& in, const std::string& out, const std::function<void(Bitmap&)>& filter,
+                  int32_t rows = STRIPROWS, int32_t halo = 0, int32_t align = 1);
+
+// Strip by strip versions of the filters, output is byte for byte the same as
+// loading the whole image and calling the filter on it
+void streamGrayscale(const std::string& in, const std::string& out, int32_t rows = STRIPROWS);
+void streamCellShade(const std::string& in, const std::string& out, int32_t rows = STRIPROWS);
+void streamBinaryGray(const std::string& in, const std::string& out, int32_t isovalue, int32_t rows = STRIPROWS);
+void streamBlur(const std::string& in, const std::string& out, int32_t radius = BLURRADIUS, int32_t rows = STRIPROWS);
+void streamPixelate(const std::string& in, const std::string& out, int32_t block = PIXELATEBLOCK, int32_t rows = STRIPROWS);
+void streamScaleDown(const std::string& in, const std::string& out, int32_t rows = STRIPROWS);
+
+#endif // BITMAPSTREAM_H
@@ -0,0 +1,91 @@
+#include "BufferPool.h"
+
+BufferPool& BufferPool::instance(){
+    // Never destroyed, bitmaps living in static storage may still free into it on exit
+    static BufferPool* pool = new BufferPool();
+    return *pool;
+}
+
+size_t BufferPool::sizeClass(size_t bytes) noexcept{
+    if( bytes < MINBYTES )
+        return bytes;
+    // Four classes between each power of two, so at most a quarter is wasted
+    size_t top = 1;
+    while( top <= bytes >> 1 ){
+        top <<= 1;
+    }
+    const size_t quarter = top >> 2;
+    return (bytes + quarter - 1) / quarter * quarter;
+}
+
+void* BufferPool::acquire(size_t bytes){
+    const size_t size = sizeClass(bytes);
+    if( size >= MINBYTES ){
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _free.find(size);
+        if( it != _free.end() && !it->second.empty() ){
+            void* p = it->second.back();
+            it->second.pop_back();
+            _cached -= size;
+            return p;
+        }
+    }
+    try{
+        return ::operator new(size, std::align_val_t(ALIGN));
+    }catch( const std::bad_alloc& ){
+        // Whatever is sitting idle is better spent on this
+        trim(0);
+        return ::operator new(size, std::align_val_t(ALIGN));
+    }
+}
+
+void BufferPool::release(void* p, size_t bytes) noexcept{
+    if( !p )
+        return;
+    const size_t size = sizeClass(bytes);
+    if( size >= MINBYTES ){
+        std::lock_guard<std::mutex> lock(_mutex);
+        if( _cached + size <= _capacity ){
+            try{
+                _free[size].push_back(p);
+                _cached += size;
+                return;
+            }catch( ... ){
+                // No room to remember it, free it instead
+            }
+        }
+    }
+    ::operator delete(p, std::align_val_t(ALIGN));
+}
+
+void BufferPool::setCapacity(size_t bytes){
+    std::lock_guard<std::mutex> lock(_mutex);
+    _capacity = bytes;
+    _trim(bytes);
+}
+
+size_t BufferPool::capacity() const{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _capacity;
+}
+
+size_t BufferPool::cached() const{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _cached;
+}
+
+void BufferPool::trim(size_t bytes){
+    std::lock_guard<std::mutex> lock(_mutex);
+    _trim(bytes);
+}
+
+void BufferPool::_trim(size_t bytes) noexcept{
+    for( auto it = _free.rbegin(); it != _free.rend() && _cached > bytes; ++it ){
+        auto& list = it->second;
+        while( !list.empty() && _cached > bytes ){
+            ::operator delete(list.back(), std::align_val_t(ALIGN));
+            list.pop_back();
+            _cached -= it->first;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * Keeps large pixel buffers around after they are freed so the next working copy of
+ * the same size can take one instead of going back to the allocator.
+ *
+ * Requests are rounded up to a size class, four classes per power of two, and a freed
+ * buffer goes on the list for its class. Once capacity() bytes are sitting idle any
+ * further buffers are really freed. Requests under MINBYTES are not worth keeping and
+ * go straight to operator new. Buffers are aligned to ALIGN bytes.
+ */
+class BufferPool
+{
+public:
+    static constexpr size_t MINBYTES = 64 * 1024;
+    static constexpr size_t ALIGN    = 64;
+    static constexpr size_t DEFAULTCAPACITY = size_t(256) * 1024 * 1024;
+
+    // The pool shared by every Bitmap
+    static BufferPool& instance();
+
+    explicit BufferPool(size_t capacity = DEFAULTCAPACITY):_capacity{capacity}{}
+    ~BufferPool(){ trim(0); }
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Returns a buffer of at least bytes bytes
+    void* acquire(size_t bytes);
+    // Gives back a buffer from acquire, bytes must be the same as was asked for
+    void  release(void* p, size_t bytes) noexcept;
+
+    // Most bytes kept idle, lowering it frees buffers straight away
+    void   setCapacity(size_t bytes);
+    size_t capacity() const;
+    // Bytes currently idle in the pool
+    size_t cached() const;
+    // Frees idle buffers, largest first, until no more than bytes remain
+    void   trim(size_t bytes = 0);
+
+    // The size actually allocated for a request of bytes
+    static size_t sizeClass(size_t bytes) noexcept;
+
+private:
+    mutable std::mutex _mutex;
+    size_t _capacity;
+    size_t _cached = 0;
+    std::map<size_t, std::vector<void*>> _free;
+
+    void _trim(size_t bytes) noexcept;
+};
+
+/*
+ * Allocator drawing from BufferPool::instance(). Elements are default initialized, so
+ * resizing a vector of bytes leaves the new ones as they come instead of zeroing them,
+ * the filters overwrite them anyway.
+ */
+template<typename T>
+struct PoolAllocator{
+    typedef T value_type;
+
+    PoolAllocator() = default;
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&){}
+
+    T* allocate(size_t n){ return static_cast<T*>(BufferPool::instance().acquire(n*sizeof(T))); }
+    void deallocate(T* p, size_t n) noexcept{ BufferPool::instance().release(p, n*sizeof(T)); }
+
+    template<typename U>
+    void construct(U* p) noexcept{ ::new(static_cast<void*>(p)) U; }
+    template<typename U, typename... ARGS>
+    void construct(U* p, ARGS&&... args){ ::new(static_cast<void*>(p)) U(std::forward<ARGS>(args)...); }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const{ return true; }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>&) const{ return false; }
+};
+
+// Byte buffer backed by the pool
+typedef std::vector<uint8_t, PoolAllocator<uint8_t>> PixelBuffer;
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,55 @@
+#ifndef COMMANDRING_HPP
+#define COMMANDRING_HPP
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/*
+ * A fixed size ring for handing values from exactly one producer thread to exactly one
+ * consumer thread without locks. Each side owns one index and only reads the other's,
+ * a slot is written before the index that hands it over and read before the index
+ * that gives it back.
+ *
+ * The indices are stored sequentially consistent, so a producer that pushes and then
+ * checks a flag the consumer sets before checking empty() never misses it, the pair
+ * either sees the value or the flag. That is what lets the consumer sleep when idle.
+ */
+template<typename T, size_t N>
+class CommandRing
+{
+    static_assert( N > 0 && (N & (N - 1)) == 0, "capacity is a power of two" );
+public:
+    static constexpr size_t capacity = N;
+
+    // Producer only, false when the ring is full
+    bool push(const T& value){
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if( tail - _head.load(std::memory_order_acquire) == N )
+            return false;
+        _slots[tail & (N - 1)] = value;
+        _tail.store(tail + 1);
+        return true;
+    }
+
+    // Consumer only, false when the ring is empty
+    bool pop(T& value){
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if( head == _tail.load(std::memory_order_acquire) )
+            return false;
+        value = _slots[head & (N - 1)];
+        _head.store(head + 1);
+        return true;
+    }
+
+    // Either side, exact for the side calling it as far as its own index goes
+    size_t size() const{ return _tail.load() - _head.load(); }
+    bool empty() const{ return size() == 0; }
+
+private:
+    // Apart so the two threads do not keep taking the same cache line from each other
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+    alignas(64) std::array<T, N> _slots;
+};
+
+#endif // COMMANDRING_HPP
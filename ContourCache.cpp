@@ -0,0 +1,79 @@
+#include <functional>
+#include "ContourCache.h"
+
+namespace {
+size_t polygonBytes(const std::vector<std::vector<pt>>& polygons){
+    size_t bytes = polygons.capacity() * sizeof(std::vector<pt>);
+    for( auto& p: polygons ){
+        bytes += p.capacity() * sizeof(pt);
+    }
+    return bytes;
+}
+}
+
+size_t ContourResult::bytes() const{
+    return sizeof(*this) + polygonBytes(polygons) + polygonBytes(hulls);
+}
+
+size_t ContourCache::KeyHash::operator()(const ContourKey& k) const{
+    size_t h = std::hash<uint64_t>()(k.generation);
+    h = h * 31 + std::hash<int32_t>()(k.isovalue);
+    h = h * 31 + std::hash<int32_t>()(k.stepsize);
+    return h * 2 + k.binaryInterp;
+}
+
+std::shared_ptr<const ContourResult> ContourCache::find(const ContourKey& key){
+    auto it = _index.find(key);
+    if( it == _index.end() )
+        return nullptr;
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return it->second->result;
+}
+
+void ContourCache::insert(const ContourKey& key, std::shared_ptr<const ContourResult> result){
+    // Older generations can never be asked for again
+    for( auto it = _entries.begin(); it != _entries.end(); ){
+        if( it->key.generation < key.generation ){
+            _cached -= it->bytes;
+            _index.erase(it->key);
+            it = _entries.erase(it);
+        }else{
+            ++it;
+        }
+    }
+
+    auto existing = _index.find(key);
+    if( existing != _index.end() ){
+        _cached -= existing->second->bytes;
+        _entries.erase(existing->second);
+        _index.erase(existing);
+    }
+
+    const size_t bytes = result->bytes();
+    if( bytes > _capacity )
+        return;
+    evict(_capacity - bytes);
+    _entries.push_front( Entry{ key, std::move(result), bytes } );
+    _index[key] = _entries.begin();
+    _cached += bytes;
+}
+
+void ContourCache::clear(){
+    _entries.clear();
+    _index.clear();
+    _cached = 0;
+}
+
+void ContourCache::setCapacity(size_t bytes){
+    _capacity = bytes;
+    evict(bytes);
+}
+
+// Drops the least recently used until no more than bytes are held
+void ContourCache::evict(size_t bytes){
+    while( _cached > bytes && !_entries.empty() ){
+        _cached -= _entries.back().bytes;
+        _index.erase(_entries.back().key);
+        _entries.pop_back();
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef CONTOURCACHE_H
+#define CONTOURCACHE_H
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "point.hpp"
+
+/*
+ * Contours and hulls already worked out, so going back to a recent isovalue or view
+ * does not trace anything. Results are looked up by what they depend on: the image,
+ * through a generation number that goes up every time the image changes, and the
+ * parameters of findContours.
+ *
+ * The least recently used results go first once more than capacity() bytes are held,
+ * and a result from a newer generation pushes out every older one, the image they
+ * were for is gone. Results are handed out shared so dropping one never pulls it out
+ * from under whoever is drawing it. Not thread safe.
+ */
+
+struct ContourKey{
+    uint64_t generation;
+    int32_t  isovalue;
+    int32_t  stepsize;
+    // Binary interpolation, or the binary display which gives the same contours
+    bool     binaryInterp;
+
+    bool operator==(const ContourKey& o) const{
+        return generation == o.generation && isovalue == o.isovalue
+            && stepsize == o.stepsize && binaryInterp == o.binaryInterp;
+    }
+};
+
+struct ContourResult{
+    std::vector<std::vector<pt>> polygons;
+    std::vector<std::vector<pt>> hulls;
+
+    // Heap bytes the result holds, near enough
+    size_t bytes() const;
+};
+
+class ContourCache
+{
+public:
+    static constexpr size_t DEFAULTCAPACITY = size_t(64) * 1024 * 1024;
+
+    explicit ContourCache(size_t capacity = DEFAULTCAPACITY):_capacity{capacity}{}
+
+    // The result for key, null when there is none, counts as a use
+    std::shared_ptr<const ContourResult> find(const ContourKey& key);
+    // Keeps result for key, unless it is bigger than the whole cache
+    void insert(const ContourKey& key, std::shared_ptr<const ContourResult> result);
+    void clear();
+
+    void   setCapacity(size_t bytes);
+    size_t capacity() const{ return _capacity; }
+    // Bytes held by the results kept
+    size_t cached() const{ return _cached; }
+
+private:
+    struct KeyHash{
+        size_t operator()(const ContourKey& k) const;
+    };
+    struct Entry{
+        ContourKey key;
+        std::shared_ptr<const ContourResult> result;
+        size_t bytes;
+    };
+
+    size_t _capacity;
+    size_t _cached = 0;
+    // Most recently used first
+    std::list<Entry> _entries;
+    std::unordered_map<ContourKey, std::list<Entry>::iterator, KeyHash> _index;
+
+    void evict(size_t bytes);
+};
+
+#endif // CONTOURCACHE_H
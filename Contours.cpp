@@ -0,0 +1,927 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include "bitmap.h"
+#include "jarvisMarch.hpp"
+#include "Tiling.hpp"
+#include "Contours.h"
+
+namespace {
+
+// Sides of a cell, by the corners at their ends in the order make_edge puts them
+enum CellSide : uint8_t { Bottom, Right, Top, Left };
+struct SideEnds{
+    uint8_t x0, y0, x1, y1;
+};
+constexpr SideEnds SIDEENDS[4] = { {0,0, 1,0}, {1,0, 1,1}, {0,1, 1,1}, {0,0, 0,1} };
+
+/*
+ * What a contour does in each of the 16 cases, the sides it crosses two at a time. The
+ * saddles 5 and 10 cross all four, the pair by the top right corner comes first and is
+ * the one tracing takes, the pair by the bottom left is the alternative. The rest have
+ * one pair, the sides in the order top, left, bottom, right.
+ */
+struct CellCase{
+    uint8_t pairs;
+    CellSide side[2][2];
+};
+
+constexpr array<CellCase, 16> makeCases(){
+    array<CellCase, 16> cases{};
+    // Corners each side runs between, bit 0 is (0,0), 1 is (1,0), 2 is (1,1), 3 is (0,1)
+    constexpr uint8_t ends[4][2] = { {0,1}, {1,2}, {3,2}, {0,3} };
+    // The order sides come in within a pair
+    constexpr CellSide order[4] = { Top, Left, Bottom, Right };
+    for( uint8_t square = 1; square < 15; ++square ){
+        CellCase& c = cases[square];
+        if( square == 5 || square == 10 ){
+            c.pairs = 2;
+            c.side[0][0] = Top;  c.side[0][1] = Right;
+            c.side[1][0] = Left; c.side[1][1] = Bottom;
+            continue;
+        }
+        c.pairs = 1;
+        uint8_t found = 0;
+        for( CellSide side: order ){
+            if( ( square >> ends[side][0] & 1 ) != ( square >> ends[side][1] & 1 ) )
+                c.side[0][found++] = side;
+        }
+    }
+    return cases;
+}
+constexpr array<CellCase, 16> CASES = makeCases();
+
+static_assert( CASES[1].side[0][0] == Left && CASES[1].side[0][1] == Bottom, "case 1 is left then bottom" );
+static_assert( CASES[7].side[0][0] == Top  && CASES[7].side[0][1] == Left,   "case 7 is top then left" );
+static_assert( CASES[5].pairs == 2 && CASES[0].pairs == 0 && CASES[15].pairs == 0, "only the saddles have two pairs" );
+
+typedef ContourCell Cell;
+
+uint64_t bits(double v){
+    v += 0.0;   // -0 becomes 0
+    uint64_t b;
+    memcpy(&b, &v, sizeof b);
+    return b;
+}
+
+uint64_t hashPoint(const pt& p){
+    uint64_t h = bits(p.x) * 0x9E3779B97F4A7C15ull ^ bits(p.y);
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 32;
+    return h;
+}
+
+/*
+ * Crossing points to the cells that have them, by value. Each point keeps its cells
+ * in a list in the order they were added. -0 and 0 are the same point, NaN is never
+ * equal to anything so it is never added.
+ */
+class PointIndex{
+public:
+    explicit PointIndex(size_t points){
+        size_t size = 16;
+        while( size < 2*points ){
+            size <<= 1;
+        }
+        _slots.resize(size, Slot{ 0, 0, -1, -1 });
+        _mask = size - 1;
+        _cell.reserve(points);
+        _next.reserve(points);
+    }
+
+    void add(const pt& p, int32_t cell){
+        if( std::isnan(p.x) || std::isnan(p.y) )
+            return;
+        Slot& s = _slots[find(p)];
+        const int32_t link = int32_t(_cell.size());
+        _cell.push_back(cell);
+        _next.push_back(-1);
+        if( s.head < 0 ){
+            s.x = p.x;
+            s.y = p.y;
+            s.head = link;
+        }else{
+            _next[s.tail] = link;
+        }
+        s.tail = link;
+    }
+
+    // First link of the list for p, -1 when no cell has it
+    int32_t first(const pt& p) const{
+        if( std::isnan(p.x) || std::isnan(p.y) )
+            return -1;
+        return _slots[find(p)].head;
+    }
+    int32_t next(int32_t link) const{ return _next[link]; }
+    int32_t cell(int32_t link) const{ return _cell[link]; }
+
+private:
+    struct Slot{
+        double x, y;
+        int32_t head, tail;
+    };
+    vector<Slot> _slots;
+    vector<int32_t> _cell;
+    vector<int32_t> _next;
+    size_t _mask;
+
+    // Slot holding p, or the empty one it would go in
+    size_t find(const pt& p) const{
+        size_t i = hashPoint(p) & _mask;
+        while( _slots[i].head >= 0 && !(_slots[i].x == p.x && _slots[i].y == p.y) ){
+            i = (i + 1) & _mask;
+        }
+        return i;
+    }
+};
+
+} // namespace
+
+uint8_t composeBits(uint8_t b, uint8_t b2, uint8_t b3 ){
+    // This maps 2,3 to 1,4, then sets 2, 3 to new bits
+    // This allows us to march forward with only two iterators
+    return ( (b << 1 | b >> 1) & 0b1001 ) | b2 << 1 | b3 << 2;
+}
+// sp != sq or else arithmetic error, divide by zero
+pt interpolation( pt p, pt q, point_t sp, point_t sq, point_t sigma){
+    double alpha = (sigma - sp)/(sq - sp);
+    return pt( (1-alpha)*p.x + alpha*q.x, (1-alpha)*p.y + alpha*q.y );
+}
+
+namespace {
+
+// Cells as (column, j), column being i/step
+typedef vector<pair<uint32_t, uint32_t>> CellList;
+
+// Cells found a row at a time put in (i,j) order, x before y, which is the order tracing takes them in
+CellList byColumn(CellList& found, uint32_t columns){
+    vector<uint32_t> perColumn(columns + 1, 0);
+    for( auto& f: found ){
+        ++perColumn[f.first+1];
+    }
+    for( uint32_t c = 0; c < columns; ++c ){
+        perColumn[c+1] += perColumn[c];
+    }
+    CellList ordered(found.size());
+    for( auto& f: found ){
+        ordered[perColumn[f.first]++] = f;
+    }
+    found.clear();
+    found.shrink_to_fit();
+    return ordered;
+}
+
+/*
+ * Crossing points of the cell at (i,j), on the sides the first pair of its case gives,
+ * the ends of each side ordered the same for the cells either side of it so both work
+ * out the same point. value(p) is what crossing points are interpolated between.
+ */
+template<typename VALUE>
+inline Cell makeCell(uint32_t i, uint32_t j, uint8_t square, uint32_t step, VALUE value){
+    const CellCase& c = CASES[square];
+    auto cross = [&](CellSide side){
+        const SideEnds& e = SIDEENDS[side];
+        const pt p( i + e.x0*step, j + e.y0*step );
+        const pt q( i + e.x1*step, j + e.y1*step );
+        return interpolation(p, q, value(p), value(q), 0);
+    };
+    return Cell{ pt(i,j), cross(c.side[0][0]), cross(c.side[0][1]) };
+}
+
+// makeCell for each of ordered, above(i,j) is 1 for a corner above the isovalue
+template<typename ABOVE, typename VALUE>
+vector<Cell> crossings(const CellList& ordered, uint32_t step, ABOVE above, VALUE value){
+    vector<Cell> cells(ordered.size());
+    for( size_t k = 0; k < ordered.size(); ++k ){
+        const uint32_t i = ordered[k].first * step;
+        const uint32_t j = ordered[k].second;
+        const uint8_t square = above(i,j) | above(i+step,j) << 1 | above(i+step,j+step) << 2 | above(i,j+step) << 3;
+        cells[k] = makeCell(i, j, square, step, value);
+    }
+    return cells;
+}
+
+/*
+ * Calls f(c, j, square) for each cell of rows [j0,j1) a contour goes through, a row at
+ * a time. j0 is a multiple of step.
+ */
+template<typename F>
+inline void scanCells(const uint8_t* field, uint32_t w, size_t stride, uint32_t step,
+                      uint32_t j0, uint32_t j1, F&& f)
+{
+    for( uint32_t j = j0; j < j1; j += step ){
+        const uint8_t* bottom = field + size_t(j)*stride;
+        const uint8_t* top    = bottom + size_t(step)*stride;
+        // Set the bits in 2 and 3 as the next step will move them to the correct 1 and 4 position
+        uint8_t ot = top[0] << 2 | bottom[0] << 1;
+        for( uint32_t i = 0, c = 0; i < w - step; i += step, ++c ){
+            // Bitwise map pos 2,3 to 1,4
+            ot = composeBits(ot, bottom[i+step], top[i+step]);
+            if( ot != 0 && ot != 15 ){
+                f(c, j, ot);
+            }
+        }
+    }
+}
+
+/*
+ * Cells of rows [j0,j1) a contour goes through, in (i,j) order. One pass counts the
+ * cells in each column and a second writes each straight to its place, so nothing is
+ * allocated once the two arrays are.
+ */
+vector<Cell> findCells(const uint8_t* field, uint32_t w, size_t stride, uint32_t step,
+                       uint32_t j0, uint32_t j1, const ContourSamples& samples)
+{
+    const uint32_t columns = (w - 1) / step;
+    vector<uint32_t> perColumn(columns + 1, 0);
+    scanCells(field, w, stride, step, j0, j1, [&](uint32_t c, uint32_t, uint8_t){ ++perColumn[c+1]; });
+    for( uint32_t c = 0; c < columns; ++c ){
+        perColumn[c+1] += perColumn[c];
+    }
+
+    vector<Cell> cells(perColumn[columns]);
+    auto value = [&samples](const pt& p)->point_t{ return samples(ptrdiff_t(p.x), ptrdiff_t(p.y)); };
+    scanCells(field, w, stride, step, j0, j1, [&](uint32_t c, uint32_t j, uint8_t square){
+        cells[perColumn[c]++] = makeCell(c*step, j, square, step, value);
+    });
+    return cells;
+}
+
+// Bands of whole cell rows for tracing in parallel, [y0,y1) are the rows the cells start on
+vector<Tile> cellBands(uint32_t w, uint32_t h, uint32_t step){
+    const uint32_t bandRows = max( 1u, CONTOURBAND / step ) * step;
+    vector<Tile> bands;
+    for( uint32_t j = 0; j < h - step; j += bandRows ){
+        bands.push_back( Tile{ 0, int32_t(j), int32_t(w), int32_t( min( j + bandRows, h - step ) ) } );
+    }
+    return bands;
+}
+
+PointIndex indexCells(const vector<Cell>& cells){
+    PointIndex index(2*cells.size());
+    for( size_t k = 0; k < cells.size(); ++k ){
+        index.add(cells[k].first, int32_t(k));
+        if( cells[k].second != cells[k].first )
+            index.add(cells[k].second, int32_t(k));
+    }
+    return index;
+}
+
+/*
+ * Traces every cell not already taken, adding the polygons in the order of the cell
+ * each starts from. Only cells sharing a point are ever walked between, so the cells
+ * can be any set that leaves no cell sharing a point with one outside of it.
+ */
+void trace(const vector<Cell>& cells, const PointIndex& index, vector<uint8_t>& taken,
+           vector<vector<pt>>& polygons)
+{
+    vector<int32_t> candidates;
+    size_t start = 0;
+    for(;;){
+        while( start < cells.size() && taken[start] ){
+            ++start;
+        }
+        if( start == cells.size() )
+            break;
+
+        // Prime the pump with the first cell left
+        const Cell& s = cells[start];
+        taken[start] = 1;
+        vector<pt> poly = { s.corner };
+        pt last_edge = s.second;
+        pt current_edge = s.first;
+        pt cv = s.corner;
+
+        for(;;){
+            candidates.clear();
+            for( int32_t link = index.first(current_edge); link >= 0; link = index.next(link) ){
+                if( !taken[index.cell(link)] )
+                    candidates.push_back(index.cell(link));
+            }
+            if( candidates.empty() ){
+                // Broken segment, start a new polygon
+                break;
+            }
+            // The closest cell if there is ambiguity, the last one found on a tie with it
+            int32_t best = candidates.back(); candidates.pop_back();
+            for( int32_t k: candidates ){
+                if( distance(cv, cells[k].corner) < distance(cv, cells[best].corner) ){
+                    best = k;
+                }
+            }
+
+            const Cell& next = cells[best];
+            cv = next.corner;
+            if( current_edge == next.first ){
+                poly.emplace_back(next.first);
+                current_edge = next.second;
+            }else{
+                poly.emplace_back(next.second);
+                current_edge = next.first;
+            }
+            taken[best] = 1;
+
+            if( current_edge == last_edge )
+                break;
+        }
+        polygons.emplace_back(move(poly));
+    }
+}
+
+bool startsBefore(const vector<pt>& a, const vector<pt>& b){
+    return a.front().x < b.front().x || ( a.front().x == b.front().x && a.front().y < b.front().y );
+}
+
+} // namespace
+
+vector<Cell> contourCells(const uint8_t* field, uint32_t w, uint32_t h, size_t stride,
+                          uint32_t step, const ContourSamples& samples)
+{
+    if( step == 0 || w <= step || h <= step )
+        return vector<Cell>();
+    return findCells(field, w, stride, step, 0, h - step, samples);
+}
+
+vector<vector<pt>> marchingSquares(const uint8_t* field, uint32_t w, uint32_t h, size_t stride,
+                                   uint32_t step, const ContourSamples& samples, Execution exec)
+{
+    vector<vector<pt>> polygons;
+    if( step == 0 || w <= step || h <= step )
+        return polygons;
+
+    const vector<Tile> bands = cellBands(w, h, step);
+    const uint32_t bandRows = bands[0].height();
+
+    if( exec == Execution::Serial || bands.size() == 1 ){
+        vector<Cell> cells = contourCells(field, w, h, stride, step, samples);
+        vector<uint8_t> taken(cells.size(), 0);
+        trace(cells, indexCells(cells), taken, polygons);
+        return polygons;
+    }
+
+    /*
+     * Points strictly between the rows a band's cells start and end on belong to it,
+     * the seams and anything beyond the first and last band belong to no band. A point
+     * is only shared with another band if it lies outside its own band, or if another
+     * band came up with it outside of that one's.
+     */
+    const size_t n = bands.size();
+    auto inside = [&](size_t b, const pt& p){
+        const double lower = b == 0 ? -INFINITY : bands[b].y0;
+        const double upper = b + 1 == n ? INFINITY : bands[b].y1;
+        return std::isnan(p.y) || std::isnan(p.x) || ( lower < p.y && p.y < upper );
+    };
+
+    vector<vector<Cell>> cells(n);
+    vector<vector<pt>> outside(n);
+    forEachTile( bands, exec, [&](const Tile& band){
+        const size_t b = band.y0 / bandRows;
+        cells[b] = findCells(field, w, stride, step, band.y0, band.y1, samples);
+        for( const Cell& c: cells[b] ){
+            if( !inside(b, c.first) )
+                outside[b].push_back(c.first);
+            if( !inside(b, c.second) )
+                outside[b].push_back(c.second);
+        }
+    });
+
+    size_t strays = 0;
+    for( auto& o: outside ){
+        strays += o.size();
+    }
+    PointIndex seams(strays);
+    for( auto& o: outside ){
+        for( const pt& p: o ){
+            if( seams.first(p) < 0 )
+                seams.add(p, 0);
+        }
+        o.clear();
+        o.shrink_to_fit();
+    }
+
+    /*
+     * Each band traces the contours that stay inside it. Those that reach a seam, every
+     * cell connected to one through shared points, are left for the stitching pass.
+     */
+    vector<vector<vector<pt>>> traced(n);
+    vector<vector<Cell>> open(n);
+    forEachTile( bands, exec, [&](const Tile& band){
+        const size_t b = band.y0 / bandRows;
+        const vector<Cell>& mine = cells[b];
+        const PointIndex index = indexCells(mine);
+        auto shared = [&](const pt& p){ return !inside(b, p) || seams.first(p) >= 0; };
+
+        vector<uint8_t> taken(mine.size(), 0);
+        vector<int32_t> reach;
+        for( size_t k = 0; k < mine.size(); ++k ){
+            if( shared(mine[k].first) || shared(mine[k].second) ){
+                taken[k] = 1;
+                reach.push_back(int32_t(k));
+            }
+        }
+        while( !reach.empty() ){
+            const Cell& c = mine[reach.back()];
+            reach.pop_back();
+            for( const pt* p: { &c.first, &c.second } ){
+                for( int32_t link = index.first(*p); link >= 0; link = index.next(link) ){
+                    if( !taken[index.cell(link)] ){
+                        taken[index.cell(link)] = 1;
+                        reach.push_back(index.cell(link));
+                    }
+                }
+            }
+        }
+        for( size_t k = 0; k < mine.size(); ++k ){
+            if( taken[k] )
+                open[b].push_back(mine[k]);
+        }
+        trace(mine, index, taken, traced[b]);
+        cells[b].clear();
+        cells[b].shrink_to_fit();
+    });
+
+    // Stitch the contours crossing seams, their cells back in (i,j) order across bands
+    vector<Cell> crossing;
+    for( auto& o: open ){
+        crossing.insert(crossing.end(), o.begin(), o.end());
+    }
+    stable_sort( crossing.begin(), crossing.end(), [](const Cell& a, const Cell& b){ return a.corner.x < b.corner.x; } );
+    vector<uint8_t> taken(crossing.size(), 0);
+    trace(crossing, indexCells(crossing), taken, polygons);
+
+    // Every list is in the order of the cells the polygons start from, as serial tracing has them
+    for( auto& t: traced ){
+        move( t.begin(), t.end(), back_inserter(polygons) );
+    }
+    stable_sort( polygons.begin(), polygons.end(), startsBefore );
+    return polygons;
+}
+
+vector<vector<vector<pt>>> marchingSquaresLevels(const uint8_t* gray, uint32_t w, uint32_t h, size_t stride,
+                                                 uint32_t step, const vector<int32_t>& isovalues,
+                                                 bool useBinaryInterp, const ContourSamples& samples, Execution exec)
+{
+    vector<vector<vector<pt>>> levels(isovalues.size());
+    if( step == 0 || w <= step || h <= step )
+        return levels;
+
+    // Each isovalue once, leaving out those no cell can be active for
+    vector<int32_t> sorted;
+    for( int32_t iso: isovalues ){
+        if( iso >= 0 && iso < 255 )
+            sorted.push_back(iso);
+    }
+    sort( sorted.begin(), sorted.end() );
+    sorted.erase( unique( sorted.begin(), sorted.end() ), sorted.end() );
+    if( sorted.empty() )
+        return levels;
+
+    // A cell with corners from lo to hi is active for the isovalues in [lo,hi), the
+    // levels firstLevel[lo] up to but not including firstLevel[hi]
+    array<uint32_t, 257> firstLevel;
+    for( int32_t v = 0, l = 0; v <= 256; ++v ){
+        while( l < int32_t(sorted.size()) && sorted[l] < v ){
+            ++l;
+        }
+        firstLevel[v] = l;
+    }
+
+    // One sweep over the cells hands each to every level it is active for
+    const vector<Tile> bands = cellBands(w, h, step);
+    const uint32_t bandRows = bands[0].height();
+    vector<vector<CellList>> found( bands.size(), vector<CellList>( sorted.size() ) );
+    forEachTile( bands, exec, [&](const Tile& band){
+        vector<CellList>& mine = found[band.y0 / bandRows];
+        for( uint32_t j = band.y0; j < uint32_t(band.y1); j += step ){
+            const uint8_t* bottom = gray + size_t(j)*stride;
+            const uint8_t* top    = bottom + size_t(step)*stride;
+            for( uint32_t i = 0, c = 0; i < w - step; i += step, ++c ){
+                const uint8_t lo = min( min( bottom[i], bottom[i+step] ), min( top[i], top[i+step] ) );
+                const uint8_t hi = max( max( bottom[i], bottom[i+step] ), max( top[i], top[i+step] ) );
+                for( uint32_t l = firstLevel[lo]; l < firstLevel[hi]; ++l ){
+                    mine[l].emplace_back(c, j);
+                }
+            }
+        }
+    });
+
+    // Then each level is traced on its own, as findContours would for that isovalue
+    vector<vector<vector<pt>>> traced( sorted.size() );
+    auto traceLevel = [&](size_t l){
+        CellList all;
+        for( auto& band: found ){
+            all.insert( all.end(), band[l].begin(), band[l].end() );
+            band[l].clear();
+            band[l].shrink_to_fit();
+        }
+        const CellList ordered = byColumn(all, (w - 1) / step);
+
+        const int32_t iso = sorted[l];
+        auto above = [=](uint32_t i, uint32_t j)->uint8_t{ return gray[size_t(j)*stride + i] > iso; };
+        const vector<Cell> cells = useBinaryInterp
+            ? crossings( ordered, step, above, [&](const pt& p)->point_t{ return above(uint32_t(p.x), uint32_t(p.y)); } )
+            : crossings( ordered, step, above, [&](const pt& p)->point_t{ return samples(ptrdiff_t(p.x), ptrdiff_t(p.y)); } );
+        vector<uint8_t> taken(cells.size(), 0);
+        trace(cells, indexCells(cells), taken, traced[l]);
+    };
+    if( exec == Execution::Parallel ){
+        ThreadPool::instance().run( sorted.size(), traceLevel );
+    }else{
+        for( size_t l = 0; l < sorted.size(); ++l ){
+            traceLevel(l);
+        }
+    }
+
+    // Back in the order asked for, an isovalue asked for more than once gets copies
+    vector<size_t> level(isovalues.size(), sorted.size());
+    vector<uint32_t> uses(sorted.size(), 0);
+    for( size_t k = 0; k < isovalues.size(); ++k ){
+        auto at = lower_bound( sorted.begin(), sorted.end(), isovalues[k] );
+        if( at != sorted.end() && *at == isovalues[k] ){
+            level[k] = at - sorted.begin();
+            ++uses[level[k]];
+        }
+    }
+    for( size_t k = 0; k < isovalues.size(); ++k ){
+        if( level[k] == sorted.size() )
+            continue;
+        if( --uses[level[k]] == 0 ){
+            levels[k] = move( traced[level[k]] );
+        }else{
+            levels[k] = traced[level[k]];
+        }
+    }
+    return levels;
+}
+
+namespace {
+// Cell not yet handed to a component, and a key with no cell
+const uint32_t NOCOMPONENT = UINT32_MAX;
+const uint32_t NOSLOT = UINT32_MAX;
+}
+
+void IncrementalContours::PointCells::clear(){
+    _table.assign(16, Entry{ 0, 0, -1 });
+    _next.clear();
+    _used = 0;
+}
+
+/*
+ * Entry holding p, or the empty one it would go in. An entry stays with its point once
+ * it has been used, with an empty list when no cell has the point any more.
+ */
+size_t IncrementalContours::PointCells::find(const pt& p) const{
+    const size_t mask = _table.size() - 1;
+    size_t i = hashPoint(p) & mask;
+    while( !( _table[i].head == -1 ) && !( _table[i].x == p.x && _table[i].y == p.y ) ){
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+void IncrementalContours::PointCells::grow(){
+    vector<Entry> old;
+    old.swap(_table);
+    // Entries with nobody left in them are let go of here
+    size_t live = 0;
+    for( const Entry& e: old ){
+        live += e.head >= 0;
+    }
+    size_t size = 16;
+    while( size < 4*live ){
+        size <<= 1;
+    }
+    _table.assign(size, Entry{ 0, 0, -1 });
+    _used = 0;
+    for( const Entry& e: old ){
+        if( e.head < 0 )
+            continue;
+        _table[find( pt(e.x, e.y) )] = e;
+        ++_used;
+    }
+}
+
+void IncrementalContours::PointCells::add(const pt& p, uint32_t slot, int which){
+    if( std::isnan(p.x) || std::isnan(p.y) )
+        return;
+    if( 2*(_used + 1) > _table.size() )
+        grow();
+    const int64_t link = int64_t(slot)*2 + which;
+    if( _next.size() <= size_t(link) )
+        _next.resize( max( size_t(link) + 1, 2*_next.size() ), -1 );
+    Entry& e = _table[find(p)];
+    if( e.head == -1 ){
+        e.x = p.x;
+        e.y = p.y;
+        ++_used;
+    }
+    _next[link] = e.head >= 0 ? e.head : -1;
+    e.head = link;
+}
+
+void IncrementalContours::PointCells::remove(const pt& p, uint32_t slot, int which){
+    if( std::isnan(p.x) || std::isnan(p.y) )
+        return;
+    Entry& e = _table[find(p)];
+    const int64_t link = int64_t(slot)*2 + which;
+    if( e.head == link ){
+        // Empty lists are marked -2 so the entry is not taken for a free one
+        e.head = _next[link] >= 0 ? _next[link] : -2;
+        return;
+    }
+    for( int64_t at = e.head; at >= 0; at = _next[at] ){
+        if( _next[at] == link ){
+            _next[at] = _next[link];
+            return;
+        }
+    }
+}
+
+int64_t IncrementalContours::PointCells::first(const pt& p) const{
+    if( std::isnan(p.x) || std::isnan(p.y) )
+        return -1;
+    const int64_t head = _table[find(p)].head;
+    return head >= 0 ? head : -1;
+}
+
+void IncrementalContours::load(const Bitmap& image, uint32_t step, bool useBinaryInterp){
+    _valid  = true;
+    _step   = step;
+    _binary = useBinaryInterp;
+    const uint32_t w = image.width();
+    const uint32_t h = image.height();
+    _columns = step != 0 && w > step ? (w - 1) / step : 0;
+    _rows    = step != 0 && h > step ? (h - 1) / step : 0;
+    if( _columns == 0 || _rows == 0 )
+        _columns = _rows = 0;
+
+    // Only the corners of cells are ever looked at
+    const size_t corners = _columns == 0 ? 0 : size_t(_columns + 1)*(_rows + 1);
+    _gray.assign(corners, 0);
+    _red.assign(corners, 0);
+    auto rows = image.rows();
+    if( corners != 0 ){
+        withFormat(image, [&](auto format){
+            typedef decltype(format) F;
+            for( uint32_t cy = 0; cy <= _rows; ++cy ){
+                typename F::template Row<const uint8_t> row( rows.begin()[cy*step], w );
+                for( uint32_t cx = 0; cx <= _columns; ++cx ){
+                    const uint8_t* pixel = row[cx*step];
+                    const size_t corner = size_t(cy)*(_columns + 1) + cx;
+                    _gray[corner] = luminance( pixel[F::r], pixel[F::g], pixel[F::b] );
+                    _red[corner]  = rows.begin()[cy*step][size_t(cx*step)*image.bpp() + image.rmask()];
+                }
+            }
+        });
+    }
+
+    _valueStart.assign(257, 0);
+    for( uint8_t v: _gray ){
+        ++_valueStart[v + 1];
+    }
+    for( size_t v = 0; v < 256; ++v ){
+        _valueStart[v + 1] += _valueStart[v];
+    }
+    _byValue.resize(corners);
+    vector<uint32_t> next(_valueStart.begin(), _valueStart.end() - 1);
+    for( size_t corner = 0; corner < corners; ++corner ){
+        _byValue[next[_gray[corner]]++] = uint32_t(corner);
+    }
+}
+
+bool IncrementalContours::cellAt(uint64_t key, Cell& cell) const{
+    const uint32_t c = uint32_t(key / _rows);
+    const uint32_t r = uint32_t(key % _rows);
+    const size_t across = _columns + 1;
+    auto above = [&](uint32_t cx, uint32_t cy)->uint8_t{ return _gray[size_t(cy)*across + cx] > _isovalue; };
+    const uint8_t square = above(c,r) | above(c+1,r) << 1 | above(c+1,r+1) << 2 | above(c,r+1) << 3;
+    if( square == 0 || square == 15 )
+        return false;
+
+    const uint32_t step = _step;
+    if( _binary ){
+        cell = makeCell(c*step, r*step, square, step, [&](const pt& p)->point_t{
+            return above( uint32_t(p.x) / step, uint32_t(p.y) / step );
+        });
+    }else{
+        cell = makeCell(c*step, r*step, square, step, [&](const pt& p)->point_t{
+            return _red[ size_t(uint32_t(p.y) / step)*across + uint32_t(p.x) / step ];
+        });
+    }
+    return true;
+}
+
+void IncrementalContours::activate(uint64_t key, const Cell& cell){
+    uint32_t slot;
+    if( _freeSlots.empty() ){
+        slot = uint32_t(_cells.size());
+        _cells.push_back( Active{ cell, key, NOCOMPONENT } );
+    }else{
+        slot = _freeSlots.back();
+        _freeSlots.pop_back();
+        _cells[slot] = Active{ cell, key, NOCOMPONENT };
+    }
+    _slot[key] = slot;
+    _at.add(cell.first, slot, 0);
+    if( cell.second != cell.first )
+        _at.add(cell.second, slot, 1);
+}
+
+void IncrementalContours::deactivate(uint64_t key){
+    const uint32_t slot = _slot[key];
+    if( slot == NOSLOT )
+        return;
+    const Cell& cell = _cells[slot].cell;
+    _at.remove(cell.first, slot, 0);
+    if( cell.second != cell.first )
+        _at.remove(cell.second, slot, 1);
+    _slot[key] = NOSLOT;
+    _freeSlots.push_back(slot);
+}
+
+void IncrementalContours::drop(uint32_t component){
+    auto it = _components.find(component);
+    if( it == _components.end() )
+        return;
+    for( uint64_t key: it->second.polygons ){
+        _polygons.erase(key);
+    }
+    _components.erase(it);
+}
+
+/*
+ * Traces slots, which have to be every cell of the components they are part of, and
+ * keeps what comes out as new components
+ */
+void IncrementalContours::retrace(vector<uint32_t>& slots){
+    sort( slots.begin(), slots.end(), [this](uint32_t a, uint32_t b){ return _cells[a].key < _cells[b].key; } );
+    vector<Cell> cells;
+    cells.reserve(slots.size());
+    for( uint32_t slot: slots ){
+        cells.push_back( _cells[slot].cell );
+    }
+    const PointIndex index = indexCells(cells);
+
+    vector<int32_t> reach;
+    for( size_t s = 0; s < cells.size(); ++s ){
+        if( _cells[slots[s]].component != NOCOMPONENT )
+            continue;
+        const uint32_t id = _nextComponent++;
+        Component& component = _components[id];
+        _cells[slots[s]].component = id;
+        reach.push_back(int32_t(s));
+        while( !reach.empty() ){
+            const size_t k = reach.back();
+            reach.pop_back();
+            component.slots.push_back(slots[k]);
+            for( const pt* p: { &cells[k].first, &cells[k].second } ){
+                for( int32_t link = index.first(*p); link >= 0; link = index.next(link) ){
+                    Active& next = _cells[slots[index.cell(link)]];
+                    if( next.component == NOCOMPONENT ){
+                        next.component = id;
+                        reach.push_back(index.cell(link));
+                    }
+                }
+            }
+        }
+    }
+
+    vector<uint8_t> taken(cells.size(), 0);
+    vector<vector<pt>> traced;
+    trace(cells, index, taken, traced);
+    for( auto& poly: traced ){
+        const uint64_t key = uint64_t(poly.front().x / _step)*_rows + uint64_t(poly.front().y / _step);
+        _components[ _cells[_slot[key]].component ].polygons.push_back(key);
+        _polygons.emplace_hint( _polygons.end(), key, move(poly) );
+    }
+}
+
+void IncrementalContours::rebuild(int32_t isovalue){
+    _isovalue = isovalue;
+    _slot.assign( size_t(_columns)*_rows, NOSLOT );
+    _cells.clear();
+    _freeSlots.clear();
+    _at.clear();
+    _components.clear();
+    _polygons.clear();
+
+    // A row of corners at a time, cellAt only for the cells a contour goes through
+    const size_t across = _columns + 1;
+    Cell cell;
+    for( uint32_t r = 0; r < _rows; ++r ){
+        const uint8_t* bottom = _gray.data() + size_t(r)*across;
+        const uint8_t* top    = bottom + across;
+        for( uint32_t c = 0; c < _columns; ++c ){
+            const bool a = bottom[c] > isovalue;
+            if( a == (bottom[c+1] > isovalue) && a == (top[c] > isovalue) && a == (top[c+1] > isovalue) )
+                continue;
+            const uint64_t key = uint64_t(c)*_rows + r;
+            cellAt(key, cell);
+            activate(key, cell);
+        }
+    }
+    vector<uint32_t> slots(_cells.size());
+    for( uint32_t slot = 0; slot < slots.size(); ++slot ){
+        slots[slot] = slot;
+    }
+    retrace(slots);
+}
+
+void IncrementalContours::update(const Bitmap& image, int32_t isovalue, uint32_t step, bool useBinaryInterp){
+    if( !_valid || step != _step || useBinaryInterp != _binary ){
+        load(image, step, useBinaryInterp);
+        rebuild(isovalue);
+        return;
+    }
+    if( isovalue == _isovalue || _columns == 0 ){
+        _isovalue = isovalue;
+        return;
+    }
+
+    // Corners with a luminance in (lo,hi] change sides, a big move is cheaper done over
+    const int32_t lo = max( min(isovalue, _isovalue) + 1, 0 );
+    const int32_t hi = min( max(isovalue, _isovalue), 255 );
+    const size_t first = lo <= hi ? _valueStart[lo] : 0;
+    const size_t last  = lo <= hi ? _valueStart[hi + 1] : 0;
+    if( last - first > _byValue.size() / 4 ){
+        rebuild(isovalue);
+        return;
+    }
+    _isovalue = isovalue;
+
+    // Every cell with one of those corners
+    vector<uint64_t> dirty;
+    const uint32_t across = _columns + 1;
+    for( size_t k = first; k < last; ++k ){
+        const uint32_t cx = _byValue[k] % across;
+        const uint32_t cy = _byValue[k] / across;
+        for( uint32_t c = cx == 0 ? 0 : cx - 1; c <= cx && c < _columns; ++c ){
+            for( uint32_t r = cy == 0 ? 0 : cy - 1; r <= cy && r < _rows; ++r ){
+                dirty.push_back( uint64_t(c)*_rows + r );
+            }
+        }
+    }
+    sort( dirty.begin(), dirty.end() );
+    dirty.erase( unique( dirty.begin(), dirty.end() ), dirty.end() );
+
+    vector<uint32_t> stale;
+    for( uint64_t key: dirty ){
+        if( _slot[key] == NOSLOT )
+            continue;
+        stale.push_back( _cells[_slot[key]].component );
+        deactivate(key);
+    }
+    vector<uint32_t> reached;
+    Cell cell;
+    for( uint64_t key: dirty ){
+        if( cellAt(key, cell) ){
+            activate(key, cell);
+            reached.push_back(_slot[key]);
+        }
+    }
+
+    // What is left of the contours the changed cells were part of is traced again too
+    auto release = [&](uint32_t id){
+        auto it = _components.find(id);
+        if( it == _components.end() )
+            return;
+        for( uint32_t slot: it->second.slots ){
+            Active& a = _cells[slot];
+            if( a.component == id && _slot[a.key] == slot ){
+                a.component = NOCOMPONENT;
+                reached.push_back(slot);
+            }
+        }
+        drop(id);
+    };
+    sort( stale.begin(), stale.end() );
+    stale.erase( unique( stale.begin(), stale.end() ), stale.end() );
+    for( uint32_t id: stale ){
+        release(id);
+    }
+
+    // Along with any contour those now run into
+    for( size_t k = 0; k < reached.size(); ++k ){
+        const Cell c = _cells[reached[k]].cell;
+        for( const pt* p: { &c.first, &c.second } ){
+            for( int64_t link = _at.first(*p); link >= 0; link = _at.next(link) ){
+                const uint32_t id = _cells[link / 2].component;
+                if( id != NOCOMPONENT )
+                    release(id);
+            }
+        }
+    }
+    retrace(reached);
+}
+
+vector<vector<pt>> IncrementalContours::polygons() const{
+    vector<vector<pt>> all;
+    all.reserve(_polygons.size());
+    for( auto& p: _polygons ){
+        all.push_back(p.second);
+    }
+    return all;
+}
@@ -0,0 +1,191 @@
+#ifndef CONTOURS_H
+#define CONTOURS_H
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "bitmap.h"
+#include "point.hpp"
+
+/*
+ * Marching squares over a thresholded field, the engine behind findContours.
+ *
+ * Cells sit on a step x step grid, cell (i,j) has its corners at (i,j), (i+step,j),
+ * (i+step,j+step) and (i,j+step), for i < width-step and j < height-step. Each cell a
+ * contour runs through gives two crossing points, interpolated on the edges the
+ * contour crosses, saddles taking the pair by the top right corner, the first pair of
+ * sides in the CASES table.
+ *
+ * Tracing starts from the remaining cell with the smallest (i,j), x before y, and
+ * walks from cell to cell through equal crossing points. Where more than one cell
+ * shares the point the one whose corner is nearest the last cell's corner wins. The
+ * cells are kept in flat arrays in that order and the crossing points are looked up in
+ * a hash table, so the walk costs the same for every step of it.
+ *
+ * In parallel the cell rows are cut into bands. Each band finds its cells and traces
+ * the contours that never leave it. The cells of contours reaching a seam, or sharing
+ * a crossing point with another band some other way, are traced together afterwards,
+ * and the polygons are put back in the order of their first cells. A contour's cells
+ * are walked in the same order either way, so the result is the serial one.
+ */
+
+// Rows of pixels per band in parallel, rounded down to whole cells
+const uint32_t CONTOURBAND = 256;
+
+// Where the values crossing points are interpolated between are read from
+struct ContourSamples{
+    const uint8_t* origin;      // value at (0,0)
+    std::ptrdiff_t rowStride;   // bytes from (x,y) to (x,y+1)
+    std::ptrdiff_t pixelStride; // bytes from (x,y) to (x+1,y)
+
+    double operator()(std::ptrdiff_t x, std::ptrdiff_t y) const{ return origin[y*rowStride + x*pixelStride]; }
+};
+
+// A cell a contour runs through, corner is its (i,j), first and second its crossing points
+struct ContourCell{
+    point<double> corner;
+    point<double> first;
+    point<double> second;
+};
+
+/*!
+ * \brief contourCells finds the cells a contour goes through and their crossing points,
+ *        the first stage of marchingSquares, which allocates the result and nothing else
+ * \return the cells in (i,j) order, x before y, the order tracing takes them in
+ */
+std::vector<ContourCell> contourCells(const uint8_t* field, uint32_t width, uint32_t height,
+                                      size_t stride, uint32_t step, const ContourSamples& samples);
+
+/*!
+ * \brief marchingSquares traces the contours of a thresholded field
+ * \param field one byte per pixel, 1 above the isovalue and 0 for the rest, stride
+ *        bytes from one row to the next
+ * \param step side of a cell in pixels
+ * \param samples values crossing points are interpolated between, for a point
+ *        between corners p and q the one where the values would cross 0
+ * \param exec Parallel traces bands of rows on the thread pool, the result is the same
+ * \return each polygon starts with the corner of its first cell followed by the
+ *         crossing points in the order they were walked
+ */
+std::vector<std::vector<point<double>>> marchingSquares(const uint8_t* field, uint32_t width, uint32_t height,
+                                                        size_t stride, uint32_t step, const ContourSamples& samples,
+                                                        Execution exec = Execution::Parallel);
+
+/*!
+ * \brief marchingSquaresLevels traces the contours of a grayscale field at several
+ *        isovalues in one sweep over it
+ *
+ * A cell whose corners run from lo to hi is active for exactly the isovalues in
+ * [lo,hi), so one pass hands every cell to the levels it is active for and each level
+ * then only deals with its own cells.
+ *
+ * \param gray one byte per pixel, thresholded at each isovalue the way findContours
+ *        thresholds, a corner is above when it is greater than the isovalue
+ * \param isovalues levels to trace, in any order, 0 to 255 for the full stack
+ * \param useBinaryInterp crossing points are interpolated on the thresholded field,
+ *        otherwise on samples
+ * \return the polygons marchingSquares gives for each isovalue, in the order of
+ *         isovalues
+ */
+std::vector<std::vector<std::vector<point<double>>>> marchingSquaresLevels(const uint8_t* gray, uint32_t width, uint32_t height,
+                                                                           size_t stride, uint32_t step,
+                                                                           const std::vector<int32_t>& isovalues,
+                                                                           bool useBinaryInterp, const ContourSamples& samples,
+                                                                           Execution exec = Execution::Parallel);
+
+/*
+ * Keeps the contours of an image from one isovalue to the next. Moving the isovalue
+ * only changes the cells with a corner whose luminance lies between the old and new
+ * isovalue, so only those are worked out again, and only the contours they were or
+ * become part of are traced again, whole, the others are kept as they were. A contour
+ * here is everything connected through shared crossing points, the same unit tracing
+ * works in, so the result is always the one findContours gives.
+ *
+ * The corners of the cells are read from the image once. A different step or
+ * interpolation, or invalidate(), reads them again and traces everything.
+ */
+class IncrementalContours
+{
+public:
+    // The image has changed, the next update starts over
+    void invalidate(){ _valid = false; }
+
+    /*!
+     * \brief update brings the contours up to date with isovalue, step and interpolation
+     * \param image only read when starting over, otherwise it has to be the same image
+     *        as last time
+     */
+    void update(const Bitmap& image, int32_t isovalue, uint32_t step, bool useBinaryInterp);
+
+    // The contours findContours gives for the last update, in the same order
+    std::vector<std::vector<point<double>>> polygons() const;
+
+private:
+    // Active cells by their crossing points, a list of slots per point
+    class PointCells{
+    public:
+        void clear();
+        void add(const point<double>& p, uint32_t slot, int which);
+        void remove(const point<double>& p, uint32_t slot, int which);
+        // Links to follow with next(), -1 ends the list, link/2 is the slot
+        int64_t first(const point<double>& p) const;
+        int64_t next(int64_t link) const{ return _next[link]; }
+    private:
+        struct Entry{
+            double x, y;
+            int64_t head;
+        };
+        std::vector<Entry> _table;
+        std::vector<int64_t> _next;
+        size_t _used = 0;
+        size_t find(const point<double>& p) const;
+        void grow();
+    };
+    struct Active{
+        ContourCell cell;
+        uint64_t key;
+        uint32_t component;
+    };
+    struct Component{
+        std::vector<uint32_t> slots;
+        std::vector<uint64_t> polygons;
+    };
+
+    bool _valid = false;
+    uint32_t _step = 0;
+    bool _binary = true;
+    int32_t _isovalue = 0;
+
+    // Corners of the cells, (columns+1) x (rows+1) of them, luminance and red
+    uint32_t _columns = 0;
+    uint32_t _rows = 0;
+    std::vector<uint8_t> _gray;
+    std::vector<uint8_t> _red;
+    // Corners by luminance, those with luminance v from _byValue[_valueStart[v]] on
+    std::vector<uint32_t> _byValue;
+    std::vector<uint32_t> _valueStart;
+
+    /*
+     * Cells a contour goes through, keyed by column*rows + row, the order tracing takes
+     * them in. _slot has the place in _cells of every key, or none.
+     */
+    std::vector<uint32_t> _slot;
+    std::vector<Active> _cells;
+    std::vector<uint32_t> _freeSlots;
+    PointCells _at;
+    std::unordered_map<uint32_t, Component> _components;
+    uint32_t _nextComponent = 0;
+    // Polygons by the key of the cell they start from
+    std::map<uint64_t, std::vector<point<double>>> _polygons;
+
+    void load(const Bitmap& image, uint32_t step, bool useBinaryInterp);
+    void rebuild(int32_t isovalue);
+    bool cellAt(uint64_t key, ContourCell& cell) const;
+    void activate(uint64_t key, const ContourCell& cell);
+    void deactivate(uint64_t key);
+    void drop(uint32_t component);
+    void retrace(std::vector<uint32_t>& slots);
+};
+
+#endif // CONTOURS_H
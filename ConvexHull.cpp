@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "ConvexHull.h"
+#include "ThreadPool.h"
+
+namespace {
+// Points of polygons handed to one task at a time when hulling in parallel
+const size_t HULLGRAIN = 1 << 14;
+// Fewer points than this are sorted as they are, without looking for ones inside first
+const size_t HULLFILTER = 64;
+
+/*
+ * Error free transformations, a + b and a * b as the rounded result x plus the exact
+ * error y, see Shewchuk, "Adaptive Precision Floating-Point Arithmetic and Fast Robust
+ * Geometric Predicates"
+ */
+inline void twoSum(double a, double b, double& x, double& y){
+    x = a + b;
+    const double bv = x - a;
+    const double av = x - bv;
+    y = (a - av) + (b - bv);
+}
+
+inline void twoProduct(double a, double b, double& x, double& y){
+    x = a * b;
+    y = std::fma(a, b, -x);
+}
+
+/*
+ * Adds b to the expansion e[0..n), components nonoverlapping and in increasing order
+ * of magnitude, zeros left out. Returns the new length.
+ */
+int growExpansion(double* e, int n, double b){
+    int m = 0;
+    double q = b;
+    for( int i = 0; i < n; ++i ){
+        double h;
+        twoSum(q, e[i], q, h);
+        if( h != 0 )
+            e[m++] = h;
+    }
+    if( q != 0 )
+        e[m++] = q;
+    return m;
+}
+
+// The determinant of orient2d summed without any rounding, only its sign is kept
+int orient2dExact(const pt& a, const pt& b, const pt& c){
+    double acx[2], acy[2], bcx[2], bcy[2];
+    twoSum(a.x, -c.x, acx[1], acx[0]);
+    twoSum(a.y, -c.y, acy[1], acy[0]);
+    twoSum(b.x, -c.x, bcx[1], bcx[0]);
+    twoSum(b.y, -c.y, bcy[1], bcy[0]);
+
+    // Each of the 8 products gives two terms, an expansion of them holds at most 16.
+    // The differences are usually exact, their zero tails leave out most products.
+    double e[16];
+    int n = 0;
+    auto add = [&](double a, double b){
+        if( a == 0 || b == 0 )
+            return;
+        double x, y;
+        twoProduct(a, b, x, y);
+        n = growExpansion(e, n, y);
+        n = growExpansion(e, n, x);
+    };
+    for( int i = 0; i < 2; ++i ){
+        for( int j = 0; j < 2; ++j ){
+            add(acx[i], bcy[j]);
+            add(-acy[i], bcx[j]);
+        }
+    }
+    // The largest component decides the sign
+    return n == 0 ? 0 : (e[n-1] > 0 ? 1 : -1);
+}
+
+bool lexicographic(const pt& a, const pt& b){
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+/*
+ * Copies the points that could be on the hull into scratch. The points furthest along
+ * x, y and both diagonals are on it, in counterclockwise order, anything inside the
+ * octagon they make other than its corners is not (Akl-Toussaint).
+ */
+void candidates(const pt* first, const pt* last, std::vector<pt>& scratch){
+    const size_t n = last - first;
+    if( n < HULLFILTER ){
+        scratch.assign(first, last);
+        return;
+    }
+    // minimum x, x+y, y, then maximum x-y, x, x+y, y, then minimum x-y
+    const pt* extreme[8];
+    std::fill(extreme, extreme + 8, first);
+    for( const pt* p = first + 1; p != last; ++p ){
+        if( p->x < extreme[0]->x ) extreme[0] = p;
+        if( p->x + p->y < extreme[1]->x + extreme[1]->y ) extreme[1] = p;
+        if( p->y < extreme[2]->y ) extreme[2] = p;
+        if( p->x - p->y > extreme[3]->x - extreme[3]->y ) extreme[3] = p;
+        if( p->x > extreme[4]->x ) extreme[4] = p;
+        if( p->x + p->y > extreme[5]->x + extreme[5]->y ) extreme[5] = p;
+        if( p->y > extreme[6]->y ) extreme[6] = p;
+        if( p->x - p->y < extreme[7]->x - extreme[7]->y ) extreme[7] = p;
+    }
+    pt octagon[8];
+    int corners = 0;
+    for( int i = 0; i < 8; ++i ){
+        if( corners == 0 || *extreme[i] != octagon[corners-1] )
+            octagon[corners++] = *extreme[i];
+    }
+    while( corners > 1 && octagon[corners-1] == octagon[0] )
+        --corners;
+
+    scratch.clear();
+    if( corners < 3 ){
+        scratch.assign(first, last);
+        return;
+    }
+    for( const pt* p = first; p != last; ++p ){
+        // Points on an edge between its corners go too, as long as the octagon is not
+        // flat, which needs at least one edge with the point strictly to its left
+        bool within = true;
+        bool left = false;
+        for( int i = 0; i < corners && within; ++i ){
+            const int side = orient2d(octagon[i], octagon[(i + 1) % corners], *p);
+            within = side >= 0 && *p != octagon[i];
+            left = left || side > 0;
+        }
+        if( !within || !left )
+            scratch.push_back(*p);
+    }
+}
+}
+
+int orient2d(const pt& a, const pt& b, const pt& c){
+    const double left  = (a.x - c.x) * (b.y - c.y);
+    const double right = (a.y - c.y) * (b.x - c.x);
+    const double det   = left - right;
+    // Bound on the error of det, Shewchuk's ccwerrboundA
+    const double epsilon = std::numeric_limits<double>::epsilon() / 2;
+    const double bound   = (3.0 + 16.0 * epsilon) * epsilon * (std::fabs(left) + std::fabs(right));
+    if( det > bound )
+        return 1;
+    if( -det > bound )
+        return -1;
+    return orient2dExact(a, b, c);
+}
+
+void convexHull(const pt* first, const pt* last, std::vector<pt>& scratch, std::vector<pt>& hull){
+    candidates(first, last, scratch);
+    std::sort(scratch.begin(), scratch.end(), lexicographic);
+    scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+
+    hull.clear();
+    const size_t n = scratch.size();
+    if( n < 3 ){
+        hull.assign(scratch.begin(), scratch.end());
+        return;
+    }
+    hull.resize(2*n);
+    size_t k = 0;
+    // Lower chain left to right
+    for( size_t i = 0; i < n; ++i ){
+        while( k >= 2 && orient2d(hull[k-2], hull[k-1], scratch[i]) <= 0 )
+            --k;
+        hull[k++] = scratch[i];
+    }
+    // Upper chain right to left, never popping into the lower one
+    const size_t lower = k + 1;
+    for( size_t i = n - 1; i-- > 0; ){
+        while( k >= lower && orient2d(hull[k-2], hull[k-1], scratch[i]) <= 0 )
+            --k;
+        hull[k++] = scratch[i];
+    }
+    // The last point is the first one again
+    hull.resize(k - 1);
+}
+
+std::vector<pt> convexHull(const std::vector<pt>& points){
+    std::vector<pt> scratch, hull;
+    convexHull(points.data(), points.data() + points.size(), scratch, hull);
+    return hull;
+}
+
+std::vector<std::vector<pt>> convexHulls(const std::vector<const std::vector<pt>*>& polygons, Execution exec){
+    std::vector<std::vector<pt>> hulls(polygons.size());
+    auto hullRange = [&](size_t begin, size_t end){
+        std::vector<pt> scratch;
+        for( size_t i = begin; i < end; ++i ){
+            const std::vector<pt>& p = *polygons[i];
+            convexHull(p.data(), p.data() + p.size(), scratch, hulls[i]);
+        }
+    };
+    if( exec == Execution::Serial ){
+        hullRange(0, polygons.size());
+        return hulls;
+    }
+
+    // Runs of polygons with about HULLGRAIN points between them
+    std::vector<size_t> starts{0};
+    size_t points = 0;
+    for( size_t i = 0; i < polygons.size(); ++i ){
+        points += polygons[i]->size();
+        if( points >= HULLGRAIN && i + 1 < polygons.size() ){
+            starts.push_back(i + 1);
+            points = 0;
+        }
+    }
+    starts.push_back(polygons.size());
+    ThreadPool::instance().run( starts.size() - 1, [&](size_t r){
+        hullRange(starts[r], starts[r+1]);
+    });
+    return hulls;
+}
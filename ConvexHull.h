@@ -0,0 +1,42 @@
+#ifndef CONVEXHULL_H
+#define CONVEXHULL_H
+#include <vector>
+#include "bitmap.h"
+#include "point.hpp"
+
+/*
+ * Convex hulls by Andrew's monotone chain: sort the points by x then y, then build the
+ * lower and upper chains, popping a point whenever it does not make a left turn.
+ *
+ * Turns are decided by orient2d, which is exact for every double input. The plain
+ * floating point determinant is used whenever its error bound shows the sign is
+ * certain, otherwise it is worked out again with expansion arithmetic, so nearly
+ * collinear interpolated points are never misjudged.
+ */
+
+/*!
+ * \brief orient2d the side of the line through a and b that c is on
+ * \return 1 when a, b, c turn counterclockwise (y up), -1 when clockwise and 0 when
+ *         they are collinear, exactly
+ */
+int orient2d(const pt& a, const pt& b, const pt& c);
+
+/*!
+ * \brief convexHull the hull of points in counterclockwise order (y up) from the
+ *        smallest point by x then y, without repeated or collinear points
+ * \param scratch working copy of the points, only there so its memory can be reused
+ *        from one call to the next
+ * \param hull replaced by the result, also reusing its memory
+ */
+void convexHull(const pt* first, const pt* last, std::vector<pt>& scratch, std::vector<pt>& hull);
+std::vector<pt> convexHull(const std::vector<pt>& points);
+
+/*!
+ * \brief convexHulls the hull of each polygon, in the same order
+ * \param exec Parallel deals runs of polygons out to the thread pool, each thread
+ *        reusing one scratch buffer for all of its polygons
+ */
+std::vector<std::vector<pt>> convexHulls(const std::vector<const std::vector<pt>*>& polygons,
+                                         Execution exec = Execution::Parallel);
+
+#endif // CONVEXHULL_H
@@ -1,27 +1,98 @@
 #include "ImageDisplay.h"
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <string>
-#include <sstream>
-#include <QByteArray>
 #include <QIODevice>
 #include <QTextStream>
 #include "bitmap.h"
 
+namespace {
+/*
+ * A QImage over the pixels of b, rows in the order they are stored. Layouts QImage has
+ * no format for are copied into 32 bit RGB. So are pixels that do not start on a 32 bit
+ * boundary, which QImage needs, as a mapped file leaves them wherever its header says.
+ */
+QImage view(const Bitmap& b){
+    QImage image;
+    withFormat(b, [&](auto format){
+        typedef decltype(format) F;
+        constexpr uint32_t BPP = F::bpp;
+        QImage::Format qformat = QImage::Format_Invalid;
+        if(BPP == 3 && F::r == 0 && F::g == 1 && F::b == 2)
+            qformat = QImage::Format_RGB888;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        else if(BPP == 3 && F::r == 2 && F::g == 1 && F::b == 0)
+            qformat = QImage::Format_BGR888;
+#endif
+        else if(BPP == 4 && F::r == 2 && F::g == 1 && F::b == 0 && Q_BYTE_ORDER == Q_LITTLE_ENDIAN)
+            qformat = b.hasAlpha() ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+        else if(BPP == 4 && F::r == 0 && F::g == 1 && F::b == 2)
+            qformat = b.hasAlpha() ? QImage::Format_RGBA8888 : QImage::Format_RGBX8888;
+
+        if(qformat != QImage::Format_Invalid){
+            if(reinterpret_cast<uintptr_t>(b.data()) % 4 == 0){
+                image = QImage(b.data(), b.width(), b.height(), b.rowWidth(), qformat);
+                return;
+            }
+            image = QImage(b.width(), b.height(), qformat);
+            for(int32_t y = 0; y < b.height(); ++y)
+                memcpy(image.scanLine(y), b.data() + size_t(y) * b.rowWidth(), size_t(b.width()) * BPP);
+            return;
+        }
+        image = QImage(b.width(), b.height(), QImage::Format_RGB32);
+        for(int32_t y = 0; y < b.height(); ++y){
+            auto row = b.row<BPP>(y);
+            // Stored order, the same as the views above
+            QRgb* out = reinterpret_cast<QRgb*>(image.scanLine(b.bottomUp() ? y : b.height() - 1 - y));
+            for(int32_t x = 0; x < b.width(); ++x){
+                const uint8_t* pixel = row[x];
+                out[x] = qRgb(pixel[F::r], pixel[F::g], pixel[F::b]);
+            }
+        }
+    });
+    return image;
+}
+}
+
 ImageDisplay::ImageDisplay(QString filename, int isovalue, int stepsize, bool useBinaryInter, QWidget *parent) : QWidget(parent),
-    imageLabel{new QLabel(this)},
     processor{filename, isovalue, stepsize, useBinaryInter}
 {
-    connect(&processor, &ImageProcessor::imageProcessed, this, &ImageDisplay::loadImage);
+    connect(&processor, &ImageProcessor::frameReady, this, &ImageDisplay::showFrame);
     connect(&processor, &ImageProcessor::queueUpdated, this, &ImageDisplay::processQueued);
+    connect(&processor, &ImageProcessor::chainProcessed, this, &ImageDisplay::chainProcessed);
     processor.start();
 }
-void ImageDisplay::loadImage(const QByteArray &stream){
-    pixmap.loadFromData(stream,"BMP");
-    imageLabel->setPixmap(pixmap);
-    imageLabel->resize(pixmap.size());
+void ImageDisplay::showFrame(Frame frame){
+    // The old view points into the old frame, so both are replaced together
+    QImage next = view(*frame.image);
+    // A preview is drawn as large as the image it stands for
+    const QSize shown = next.size() * frame.scale;
+    const bool resized = shown != _shown;
+    _view = next;
+    _shown = shown;
+    _frame = std::move(frame);
+    _flipped = _frame.image->bottomUp();
+    if(resized){
+        setMinimumSize(_shown);
+        resize(_shown);
+        updateGeometry();
+    }
+    update();
 
     emit imageLoaded();
 }
+void ImageDisplay::paintEvent(QPaintEvent *event){
+    Q_UNUSED(event);
+    QPainter painter(this);
+    if(_flipped){
+        painter.translate(0, _shown.height());
+        painter.scale(1, -1);
+    }
+    if(_frame.scale > 1)
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawImage(QRect(QPoint(0, 0), _shown), _view);
+}
 void ImageDisplay::save(){
     //std::ofstream of;
     //of.open( (QString("image_contour.bmp")).toStdString() );
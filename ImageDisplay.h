@@ -3,11 +3,7 @@
 
 #include <QWidget>
 #include <QPainter>
-#include <QPixmap>
-#include <QPixmap>
 #include <QImage>
-#include <QLabel>
-#include <QByteArray>
 #include <functional>
 #include "ImageProcessor.h"
 #include "bitmap.h"
@@ -17,38 +13,50 @@ class ImageDisplay : public QWidget
     Q_OBJECT
 public:
     explicit ImageDisplay(QString filename, int isovalue=ISOVALUE, int stepsize = STEPSIZE, bool useBinaryInter = true, QWidget *parent = nullptr);
-    QSizePolicy sizePolicy(){return imageLabel->sizePolicy();}
-    QSize size(){return imageLabel->size();}
+    QSize size(){return _shown;}
+    QSize sizeHint() const override{return _shown;}
+protected:
+    void paintEvent(QPaintEvent *event) override;
 private:
     void createScene();
-    QPixmap  pixmap;
 
     bool displayBinary = false;
-    QLabel *imageLabel;
+
+    /*
+     * The frame on screen and a QImage over its pixels, rows in the order they are
+     * stored. Bitmaps are usually stored bottom up, those are drawn flipped instead of
+     * turning the rows round. Previews are scaled up to _shown, the size of the full
+     * resolution image.
+     */
+    Frame  _frame;
+    QImage _view;
+    QSize  _shown;
+    bool   _flipped = false;
 
     ImageProcessor processor;
 
 signals:
     void imageLoaded();
     void processQueued(int);
+    void chainProcessed(int, double);
 
 private slots:
-    void loadImage(const QByteArray &image);
+    void showFrame(Frame frame);
 
 public slots:
-    void BinaryGray()  {processor.QueueProcess(std::mem_fn(&ImageProcessor::BinaryGray));}
-    void Pixelate()    {processor.QueueProcess(std::mem_fn(&ImageProcessor::Pixelate));}
-    void Blur()        {processor.QueueProcess(std::mem_fn(&ImageProcessor::Blur));}
-    void Contour()     {processor.QueueProcess(std::mem_fn(&ImageProcessor::Contour));}
-    void CelShade()    {processor.QueueProcess(std::mem_fn(&ImageProcessor::CelShade));}
-    void ScaleDown()   {processor.QueueProcess(std::mem_fn(&ImageProcessor::ScaleDown));}
-    void ScaleUp()     {processor.QueueProcess(std::mem_fn(&ImageProcessor::ScaleUp));}
-    void Rot90()       {processor.QueueProcess(std::mem_fn(&ImageProcessor::Rot90));}
-    void Rot180()      {processor.QueueProcess(std::mem_fn(&ImageProcessor::Rot180));}
-    void Rot270()      {processor.QueueProcess(std::mem_fn(&ImageProcessor::Rot270));}
-    void toggleBinary(){processor.QueueProcess(std::mem_fn(&ImageProcessor::toggleBinary));}
-    void LoadImage()   {processor.QueueProcess(std::mem_fn(&ImageProcessor::LoadImage));}
-    void GrayScale()   {processor.QueueProcess(std::mem_fn(&ImageProcessor::GrayScale));}
+    void BinaryGray()  {processor.QueueProcess(&ImageProcessor::BinaryGray);}
+    void Pixelate()    {processor.QueueProcess(&ImageProcessor::Pixelate);}
+    void Blur()        {processor.QueueProcess(&ImageProcessor::Blur);}
+    void Contour()     {processor.QueueProcess(&ImageProcessor::Contour);}
+    void CelShade()    {processor.QueueProcess(&ImageProcessor::CelShade);}
+    void ScaleDown()   {processor.QueueProcess(&ImageProcessor::ScaleDown);}
+    void ScaleUp()     {processor.QueueProcess(&ImageProcessor::ScaleUp);}
+    void Rot90()       {processor.QueueProcess(&ImageProcessor::Rot90);}
+    void Rot180()      {processor.QueueProcess(&ImageProcessor::Rot180);}
+    void Rot270()      {processor.QueueProcess(&ImageProcessor::Rot270);}
+    void toggleBinary(){processor.QueueProcess(&ImageProcessor::toggleBinary);}
+    void LoadImage()   {processor.QueueProcess(&ImageProcessor::LoadImage);}
+    void GrayScale()   {processor.QueueProcess(&ImageProcessor::GrayScale);}
     void setIsovalue(int isovalue){ processor.setIsovalue(isovalue);}
     void setStepSize(int stepsize){ processor.setStepSize(stepsize);}
     void setBinaryInter(bool usebininter){processor.setBinaryInter(usebininter);}
@@ -1,146 +1,393 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <fstream>
 #include <string>
-#include <sstream>
-#include <QByteArray>
 #include <QIODevice>
 #include <QTextStream>
+#include <QElapsedTimer>
 #include "ImageProcessor.h"
 
-ImageProcessor::ImageProcessor(QString filename, int isovalue, int stepsize, bool useBinaryInter, QObject *parent):
+ImageProcessor::ImageProcessor(QString filename, int isovalue, int stepsize, bool useBinaryInter,
+                               LoadMode loadMode, QObject *parent):
     QThread{parent},
-    restart{false},
-    abort{false},
+    _settings{ProcessSettings{ isovalue, int16_t(stepsize), useBinaryInter, false }},
     _filename{filename},
-    _isovalue{isovalue},
-    _stepsize{stepsize},
-    _usebinaryinter{useBinaryInter}
+    _loadmode{loadMode}
 {
-    _queueProcess(std::mem_fn(&ImageProcessor::LoadImage));
+    qRegisterMetaType<Frame>("Frame");
+    _queueProcess(&ImageProcessor::LoadImage);
 }
 
 ImageProcessor::~ImageProcessor(){
-    mutex.lock();
     abort = true;
+    mutex.lock();
     condition.wakeOne();
     mutex.unlock();
 
     wait();
 }
 void ImageProcessor::restartThread(){
-if (!isRunning()) {
+    if (!isRunning()) {
         start(LowPriority);
-    } else {
+    } else if (_parked) {
+        QMutexLocker locker(&mutex);
         condition.wakeOne();
     }
 }
 void ImageProcessor::processImage(){
-    QMutexLocker locker(&mutex);
-    isomutex.lock();      int iso         = _isovalue;          isomutex.unlock();
-    stepsizemutex.lock(); int stepsize    = _stepsize;     stepsizemutex.unlock();
-    binarymutex.lock();  bool usebininter = _usebinaryinter; binarymutex.unlock();
+    const ProcessSettings settings = _settings.load();
+    const int iso            = settings.isovalue;
+    const int stepsize       = settings.stepsize;
+    const bool usebininter   = settings.binaryInter;
+    const bool displayBinary = settings.displayBinary;
+    Bitmap& frame = backBuffer();
+    // The binary display has only 0 and 255 to interpolate between, the same as the
+    // thresholded field, so its contours are the binary interpolated ones
+    const bool binaryInterp = usebininter || displayBinary;
+    const ContourKey key{ _generation, iso, stepsize, binaryInterp };
+    std::shared_ptr<const ContourResult> result = _contourCache.find(key);
+    // Traced from source when they are not cached, before anything is drawn on it
+    auto trace = [&](const Bitmap& source){
+        if(result)
+            return;
+        _contours.update(source, iso, stepsize, binaryInterp);
+        auto traced = std::make_shared<ContourResult>();
+        traced->polygons = _contours.polygons();
+        traced->hulls = contourHulls(traced->polygons);
+        _contourCache.insert(key, traced);
+        result = std::move(traced);
+    };
     // Load image
-    if(displayBinary){
-        _bimage = _image;
-        binaryGray(_bimage, iso);
-        _cimage = _bimage;
+    if(_layout == Layout::Planar){
+        // Unpack straight into the display copy, _image is only brought up to date
+        // when an interleaved filter asks for it
+        if(!_planar.fits(frame))
+            frame = Bitmap(_image, true);
+        _planar.toInterleaved(frame);
+        trace(frame);
+        if(displayBinary)
+            binaryGray(frame, iso);
     }else{
-        _cimage = _image;
+        trace(_image);
+        frame = _image;
+        if(displayBinary)
+            binaryGray(frame, iso);
     }
 
-    contours(_cimage, iso, stepsize, usebininter);
+    drawContours(frame, result->polygons, result->hulls);
 }
 
 void ImageProcessor::LoadImage(){
+    // When mapped, these copies share the file until one of them is written to
+    loadBitmap(_image, _filename.toStdString(), _loadmode);
+    _layout = Layout::Interleaved;
+    _coarse = false;
+    _pyramid.clear();
+}
 
-    std::ifstream in;
-    in.open(_filename.toStdString(), ios::binary);
+/*
+ * The buffer the next frame is drawn into. Only this thread ever adds a reference to
+ * a frame, so once the display has let go of it nobody else can pick it up again.
+ */
+Bitmap& ImageProcessor::backBuffer(){
+    std::shared_ptr<Bitmap>& buffer = _frames[_back];
+    if(!buffer || buffer.use_count() > 1)
+        buffer = std::make_shared<Bitmap>();
+    else
+        std::atomic_thread_fence(std::memory_order_acquire); // after the display's last read
+    return *buffer;
+}
 
-    QMutexLocker locker(&mutex);
-    in >> _image;
-    _cimage = _image;
-    _bimage = _image;
-    binaryGray(_bimage, _isovalue);
+// Hands the back buffer over to the display and starts on the other one
+Frame ImageProcessor::publishFrame(int32_t scale){
+    Frame frame{ _frames[_back], scale };
+    _back ^= 1;
+    return frame;
+}
 
+/*
+ * Switch the working image over to the layout a filter wants, converting only when
+ * it is currently held in the other one. Worker thread only.
+ */
+Bitmap& ImageProcessor::interleaved(){
+    if(_layout == Layout::Planar){
+        _planar.toInterleaved(_image);
+        _layout = Layout::Interleaved;
+    }
+    return _image;
+}
+
+PlanarBitmap& ImageProcessor::planar(){
+    if(_layout == Layout::Interleaved){
+        _planar.fromInterleaved(_image);
+        _layout = Layout::Planar;
+    }
+    return _planar;
 }
 
 void ImageProcessor::ScaleDown(){
-    QMutexLocker locker(&mutex);
-    scaleDown(_image);
+    scaleDown(interleaved());
 }
 
 void ImageProcessor::Blur(){
-    QMutexLocker locker(&mutex);
-    blur(_image);
+    blur(planar());
 }
 void ImageProcessor::Contour(){
 }
 void ImageProcessor::CelShade(){
-    QMutexLocker locker(&mutex);
-    cellShade(_image);
+    cellShade(interleaved());
 }
 void ImageProcessor::Pixelate(){
-    QMutexLocker locker(&mutex);
-    pixelate(_image);
+    pixelate(interleaved());
 }
 void ImageProcessor::BinaryGray(){
-    QMutexLocker locker(&mutex);
-    binaryGray(_image, _isovalue);
+    binaryGray(interleaved(), _settings.load().isovalue);
 }
 void ImageProcessor::GrayScale(){
-    QMutexLocker locker(&mutex);
-    grayscale(_image);
+    grayscale(interleaved());
 }
 void ImageProcessor::toggleBinary(){
-    QMutexLocker locker(&mutex);
-    displayBinary = !displayBinary;
+    updateSettings([](ProcessSettings& s){ s.displayBinary = !s.displayBinary; });
 }
 void ImageProcessor::ScaleUp(){
-    QMutexLocker locker(&mutex);
-    scaleUp(_image);
+    scaleUp(interleaved());
 }
 void ImageProcessor::Rot90(){
-    QMutexLocker locker(&mutex);
-    rot90(_image);
+    rot90(interleaved());
 }
 
 void ImageProcessor::Rot180(){
-    QMutexLocker locker(&mutex);
-    rot180(_image);
+    rot180(interleaved());
 }
 
 void ImageProcessor::Rot270(){
-    QMutexLocker locker(&mutex);
-    rot270(_image);
+    rot270(interleaved());
 }
 
 void ImageProcessor::Reprocess(){
     //
 }
+
+/*
+ * Adds process to chain when it is a point filter, anything else has to see the
+ * image as the filters before it left it and so ends the chain
+ */
+bool ImageProcessor::appendPointFilter(pmf process, int32_t isovalue, PointChain& chain){
+    if(process == &ImageProcessor::GrayScale){
+        chain.append(PointOp::Grayscale);
+    }else if(process == &ImageProcessor::CelShade){
+        chain.append(PointOp::CellShade);
+    }else if(process == &ImageProcessor::BinaryGray){
+        chain.append(PointOp::BinaryGray, isovalue);
+    }else{
+        return false;
+    }
+    return true;
+}
+
+ImageProcessor::CommandKind ImageProcessor::kind(pmf process){
+    if(process == &ImageProcessor::Reprocess || process == &ImageProcessor::Contour)
+        return CommandKind::Redraw;
+    if(process == &ImageProcessor::toggleBinary)
+        return CommandKind::Setting;
+    return CommandKind::Mutate;
+}
+
+/*
+ * Settings are changed here and now and queue a redraw, two toggles cancel out before
+ * the worker ever sees them. A redraw is left out when anything is queued, the batch
+ * that is ends in a frame anyway. A full ring is waited out, the worker is emptying it.
+ */
+void ImageProcessor::_queueProcess(pmf process){
+    const CommandKind k = kind(process);
+    if(k == CommandKind::Setting){
+        (this->*process)();
+        return;
+    }
+    if(k != CommandKind::Redraw || _commands.empty()){
+        while(!_commands.push(process))
+            QThread::yieldCurrentThread();
+    }
+    emit queueUpdated(int(_commands.size()));
+    restartThread();
+}
+
+void ImageProcessor::runPointChain(const PointChain& chain){
+    Bitmap& image = interleaved();
+    QElapsedTimer timer;
+    timer.start();
+    pointChain(image, chain);
+    const double seconds = std::max(timer.nsecsElapsed(), qint64(1)) * 1e-9;
+    emit chainProcessed(chain.filters(), double(image.width()) * image.height() / seconds / 1e6);
+}
+
 void ImageProcessor::run(){
-    forever{
-        if( abort )
-            return;
-        while(!queued.isEmpty()){
-            qmutex.lock();
-            auto func = queued.takeFirst();
-            qmutex.unlock();
-            emit queueUpdated(queued.size());
-            func(this);
-            //if(queued.empty())
-            {
-                processImage();
-                std::ostringstream imageArray;
-                mutex.lock();
-                imageArray << _cimage;
-                mutex.unlock();
-                QByteArray stream(imageArray.str().data(), imageArray.str().size());
-                emit imageProcessed(stream);
-            }
-            mutex.lock();
-            if(queued.isEmpty()){
-                condition.wait(&mutex);
-            }
-            mutex.unlock();
+    QQueue<pmf> batch;
+    pmf process;
+    while(!abort){
+        while(_commands.pop(process))
+            batch.push_back(process);
+        if(!batch.isEmpty()){
+            emit queueUpdated(0);
+            runBatch(batch);
+        }else if(!refine()){
+            park();
+        }
+    }
+}
+
+/*
+ * Sleeps until a command comes in or the thread is stopped. _parked is set before the
+ * ring is looked at one last time and a command is pushed before _parked is looked at,
+ * so either this sees the command or the GUI thread sees _parked and wakes it.
+ */
+void ImageProcessor::park(){
+    _parked = true;
+    QMutexLocker locker(&mutex);
+    while(_commands.empty() && !abort)
+        condition.wait(&mutex);
+    _parked = false;
+}
+
+/*
+ * Takes a batch of commands. What changes the image goes on _pending in order, with
+ * the isovalue it was queued under, and one frame covers the whole batch, redraws
+ * included. Large images get a preview now and are caught up by refine() between
+ * batches, anything else, and a newly loaded image, is caught up here. A load gives
+ * up on everything still pending for the old image.
+ */
+void ImageProcessor::runBatch(QQueue<pmf>& batch){
+    const int32_t isovalue = _settings.load().isovalue;
+    QVector<Step> steps;
+    bool load = false;
+    for(pmf process: batch){
+        if(kind(process) != CommandKind::Mutate)
+            continue;
+        // A load replaces the image, whatever was queued before it would be thrown away
+        if(process == &ImageProcessor::LoadImage){
+            steps.clear();
+            load = true;
+        }
+        steps.push_back(Step{ process, isovalue });
+    }
+    batch.clear();
+    if(load){
+        _pending.clear();
+        _refine = false;
+        _proxyStale = true;
+    }
+
+    const bool coarse = !load && progressive();
+    // The proxy is only ever made from an image with nothing pending, while there is
+    // something pending the previews have kept it where the image is going
+    if(coarse && _proxyStale && _pending.isEmpty())
+        makeProxy();
+    for(const Step& step: steps)
+        _pending.push_back(step);
+    _refine = true;
+    if(coarse){
+        preview(steps);
+        return;
+    }
+    while(refine()){}
+}
+
+bool ImageProcessor::progressive() const{
+    return size_t(_image.width()) * _image.height() > PROGRESSIVEPIXELS;
+}
+
+void ImageProcessor::makeProxy(){
+    const Bitmap& image = interleaved();
+    const size_t pixels = size_t(image.width()) * image.height();
+    _proxyScale = (_coarse || pixels / 16 > PREVIEWPIXELS) ? 8 : 4;
+    _proxy = _pyramid.level(image, _generation, _proxyScale == 8 ? 3 : 2);
+    _proxyStale = false;
+}
+
+/*
+ * Runs one step on the proxy. Distances in pixels are scaled down with it, a blur
+ * too small to see at this scale is left out.
+ */
+void ImageProcessor::shrinkStep(const Step& step){
+    const pmf process = step.process;
+    if(process == &ImageProcessor::GrayScale){
+        grayscale(_proxy);
+    }else if(process == &ImageProcessor::CelShade){
+        cellShade(_proxy);
+    }else if(process == &ImageProcessor::BinaryGray){
+        binaryGray(_proxy, step.isovalue);
+    }else if(process == &ImageProcessor::Pixelate){
+        pixelate(_proxy, std::max(1, PIXELATEBLOCK / _proxyScale));
+    }else if(process == &ImageProcessor::Blur){
+        if(BLURRADIUS / _proxyScale >= 1)
+            blur(_proxy, BLURRADIUS / _proxyScale);
+    }else if(process == &ImageProcessor::ScaleDown){
+        scaleDown(_proxy);
+    }else if(process == &ImageProcessor::ScaleUp){
+        scaleUp(_proxy);
+    }else if(process == &ImageProcessor::Rot90){
+        rot90(_proxy);
+    }else if(process == &ImageProcessor::Rot180){
+        rot180(_proxy);
+    }else if(process == &ImageProcessor::Rot270){
+        rot270(_proxy);
+    }
+}
+
+// Runs steps on the proxy and publishes it with its contours, drawn the way processImage does
+void ImageProcessor::preview(const QVector<Step>& steps){
+    QElapsedTimer timer;
+    timer.start();
+    for(const Step& step: steps)
+        shrinkStep(step);
+
+    const ProcessSettings settings = _settings.load();
+    const bool binaryInterp = settings.binaryInter || settings.displayBinary;
+    const int32_t stepsize = std::max(1, settings.stepsize / _proxyScale);
+    Bitmap& frame = backBuffer();
+    frame = _proxy;
+    auto cont = findContours(_proxy, settings.isovalue, stepsize, binaryInterp);
+    if(settings.displayBinary)
+        binaryGray(frame, settings.isovalue);
+    drawContours(frame, cont, contourHulls(cont));
+    emit frameReady(publishFrame(_proxyScale));
+
+    if(timer.elapsed() > PREVIEWBUDGET)
+        _coarse = true;
+}
+
+/*
+ * One step of catching the full resolution image up: the next run of pending filters,
+ * point filters chained, then the frame, then a new proxy. False when there is nothing
+ * left to do. run() looks for commands between steps, so a newer batch is previewed
+ * before the rest of this one is worked through.
+ */
+bool ImageProcessor::refine(){
+    if(!_pending.isEmpty()){
+        const Step step = _pending.takeFirst();
+        PointChain chain;
+        if(appendPointFilter(step.process, step.isovalue, chain)){
+            while(!_pending.isEmpty() && appendPointFilter(_pending.first().process, _pending.first().isovalue, chain))
+                _pending.removeFirst();
+            runPointChain(chain);
+        }else{
+            (this->*step.process)();
         }
+        ++_generation;
+        _contours.invalidate();
+        _proxyStale = true;
+        return true;
+    }
+    if(_refine){
+        _refine = false;
+        processImage();
+        emit frameReady(publishFrame());
+        return true;
+    }
+    if(_proxyStale && progressive()){
+        makeProxy();
+        return true;
     }
+    return false;
 }
@@ -6,10 +6,39 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <QQueue>
+#include <QVector>
 #include <QFunctionPointer>
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <QMetaType>
 #include <QMutexLocker>
-#include "bitmap.h"
+#include "PlanarBitmap.h"
+#include "CommandRing.hpp"
+#include "Contours.h"
+#include "ContourCache.h"
+#include "ImagePyramid.h"
+
+/*
+ * A processed image as it is handed to the display. The pixels are never written to
+ * once the frame is published, so the display can show them where they are.
+ */
+struct Frame{
+    std::shared_ptr<const Bitmap> image;
+    // Pixels of the full resolution image across one pixel of image, above 1 for previews
+    int32_t scale = 1;
+};
+Q_DECLARE_METATYPE(Frame)
+
+// What the frame is drawn with, published to the worker as one 8 byte word
+struct ProcessSettings{
+    int32_t isovalue;
+    int16_t stepsize;
+    bool    binaryInter;
+    bool    displayBinary;
+};
+static_assert( sizeof(ProcessSettings) == 8, "settings fit one word, no padding" );
+static_assert( std::atomic<ProcessSettings>::is_always_lock_free, "settings are published without a lock" );
 
 class ImageProcessor : public QThread
 {
@@ -17,49 +46,71 @@ class ImageProcessor : public QThread
 
 public:
 
-    ImageProcessor(QString filename, int isovalue, int stepsize, bool useBinaryInter, QObject *parent=nullptr);
+    ImageProcessor(QString filename, int isovalue, int stepsize, bool useBinaryInter,
+                   LoadMode loadMode = LoadMode::Mapped, QObject *parent=nullptr);
     ~ImageProcessor() override;
 
     void processImage();
 
-    void setIsovalue(int isovalue){ isomutex.lock(); _isovalue = isovalue; isomutex.unlock();
-                                    _queueProcess(std::mem_fn(&ImageProcessor::Reprocess)); }
-    void setStepSize(int stepsize){ isomutex.lock(); _stepsize = stepsize; isomutex.unlock();
-                                    _queueProcess(std::mem_fn(&ImageProcessor::Reprocess));}
-    void setBinaryInter( bool binaryInter ){binarymutex.lock(); _usebinaryinter = binaryInter; binarymutex.unlock() ;
-                                    _queueProcess(std::mem_fn(&ImageProcessor::Reprocess));}
+    /*
+     * The setters and QueueProcess are for one thread only, the GUI's. Settings take
+     * effect with the next frame drawn.
+     */
+    void setIsovalue(int isovalue){ updateSettings([=](ProcessSettings& s){ s.isovalue = isovalue; }); }
+    void setStepSize(int stepsize){ updateSettings([=](ProcessSettings& s){ s.stepsize = int16_t(stepsize); }); }
+    void setBinaryInter( bool binaryInter ){ updateSettings([=](ProcessSettings& s){ s.binaryInter = binaryInter; }); }
 
 signals:
-    void imageProcessed( const QByteArray &image);
+    void frameReady(Frame frame);
     void queueUpdated(int);
+    // Filters run together as one point chain and the megapixels per second they ran at
+    void chainProcessed(int filters, double megapixelsPerSecond);
 
 protected:
     void run() override;
 
 private:
+    /*
+     * Only taken to park the worker when there is nothing to do and to wake it again,
+     * everything else the worker touches is its own or goes through _commands and
+     * _settings
+     */
     QMutex mutex;
-    QMutex qmutex;
-    QMutex isomutex;
-    QMutex stepsizemutex;
-    QMutex binarymutex;
-
     QWaitCondition condition;
+    std::atomic<bool> _parked{false};
+    std::atomic<bool> abort{false};
+    std::atomic<ProcessSettings> _settings;
 
-    bool restart;
-    bool abort;
     Bitmap _image;
-    Bitmap _bimage;
-    Bitmap _cimage;
+
+    /*
+     * Frames are drawn into one buffer while the display shows the other. A buffer the
+     * display still holds when its turn comes round again is left to it and a new one
+     * is drawn into instead, so the thread never waits on the display.
+     */
+    std::shared_ptr<Bitmap> _frames[2];
+    size_t _back = 0;
+    Bitmap& backBuffer();
+    Frame publishFrame(int32_t scale = 1);
+
+    // The working image lives in _image or _planar, whichever filter ran last decides
+    PlanarBitmap _planar;
+    Layout _layout = Layout::Interleaved;
+    Bitmap& interleaved();
+    PlanarBitmap& planar();
 
     QString _filename;
+    LoadMode _loadmode;
 
-    bool success = false;
-    bool displayBinary = false;
 
-    // Edit values
-    int _isovalue = 57;
-    int _stepsize = 5;
-    bool _usebinaryinter = true;
+    // Goes up every time the working image changes
+    uint64_t _generation = 0;
+    // Contours of the working image, kept from one isovalue to the next
+    IncrementalContours _contours;
+    // Contours and hulls for recent generations and parameters
+    ContourCache _contourCache;
+    // Shrunk copies of the working image for the current generation
+    ImagePyramid _pyramid;
 
 public:
     // Processing functions
@@ -79,16 +130,66 @@ public:
     void Rot270();
     void Reprocess();
 
-    typedef decltype(std::mem_fn<void(), ImageProcessor>(&ImageProcessor::BinaryGray)) pmf;
+    typedef void (ImageProcessor::*pmf)();
     void QueueProcess(pmf process){ _queueProcess(process);}
 private:
-
-    QQueue<pmf> queued;
-    void _queueProcess(pmf process){
-        QMutexLocker locker(&qmutex);
-        queued.push_back(process);
-        emit queueUpdated(queued.size());
-        restartThread();}
+    // Point filters queued one after another are run as a single PointChain
+    bool appendPointFilter(pmf process, int32_t isovalue, PointChain& chain);
+    // What a queued command does to the frame
+    enum class CommandKind{
+        Redraw,     // only asks for the frame to be drawn again
+        Setting,    // changes how the frame is drawn, done at once by the thread queueing it
+        Mutate      // changes the working image
+    };
+    static CommandKind kind(pmf process);
+    void runPointChain(const PointChain& chain);
+    void runBatch(QQueue<pmf>& batch);
+    void park();
+
+    /*
+     * Large images are drawn coarse to fine. A batch of commands is run on _proxy, a
+     * 1/4 or 1/8 box filtered copy of the working image, and shown straight away. The
+     * full resolution image is brought up to date between batches one run of _pending
+     * filters at a time, and its frame only drawn once nothing is left, so work on a
+     * state newer commands have already moved on from is given up.
+     */
+
+    // Images with more pixels than this are drawn coarse to fine
+    static constexpr size_t PROGRESSIVEPIXELS = size_t(1) << 22;
+    // The proxy is 1/4 of the image while that has no more pixels than this, else 1/8
+    static constexpr size_t PREVIEWPIXELS = size_t(1) << 19;
+    // Milliseconds a preview should take, the next proxy is 1/8 after one that took longer
+    static constexpr qint64 PREVIEWBUDGET = 50;
+    struct Step{
+        pmf process;
+        int32_t isovalue;
+    };
+    QQueue<Step> _pending;
+    // A full resolution frame is owed once _pending is done
+    bool _refine = false;
+    // A copy of pyramid level 2 or 3, run ahead of the image by the previews
+    Bitmap _proxy;
+    int32_t _proxyScale = 4;
+    // The proxy is made again from the caught up image before it is used next
+    bool _proxyStale = true;
+    // A preview went over budget, proxies are 1/8 until the next image is loaded
+    bool _coarse = false;
+    bool progressive() const;
+    void makeProxy();
+    void shrinkStep(const Step& step);
+    void preview(const QVector<Step>& steps);
+    bool refine();
+
+    // Commands from the GUI thread to the worker
+    CommandRing<pmf, 256> _commands;
+    void _queueProcess(pmf process);
+    template<typename F>
+    void updateSettings(F change){
+        ProcessSettings settings = _settings.load();
+        change(settings);
+        _settings.store(settings);
+        _queueProcess(&ImageProcessor::Reprocess);
+    }
 
 };
 
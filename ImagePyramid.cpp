@@ -0,0 +1,33 @@
+#include "ImagePyramid.h"
+
+const Bitmap& ImagePyramid::level(const Bitmap& image, uint64_t generation, int32_t k){
+    follow(generation);
+    if( k <= 0 )
+        return image;
+    while( _levels.size() < size_t(k) ){
+        const Bitmap& above = _levels.empty() ? image : _levels.back();
+        _levels.emplace_back();
+        boxShrink(above, _levels.back(), 2);
+    }
+    return _levels[k-1];
+}
+
+void ImagePyramid::clear(){
+    _levels.clear();
+}
+
+size_t ImagePyramid::bytes() const{
+    size_t bytes = 0;
+    for( auto& l: _levels ){
+        bytes += l.rawSize();
+    }
+    return bytes;
+}
+
+// Drops the levels when they were made for another generation
+void ImagePyramid::follow(uint64_t generation){
+    if( generation != _generation ){
+        _levels.clear();
+        _generation = generation;
+    }
+}
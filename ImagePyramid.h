@@ -0,0 +1,43 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include "bitmap.h"
+
+/*
+ * Box filtered copies of an image at 1/2, 1/4, 1/8 ... of its size, each made from the
+ * one above it, so shrinking the same image again never goes back to full resolution.
+ * Level 0 is the image itself and is not copied.
+ *
+ * The levels belong to one generation of the image, the number ImageProcessor counts
+ * up every time the image changes. Asking for a level of any other generation throws
+ * away what is held and starts again, so a changed image is never shrunk from stale
+ * levels. Levels are only made when first asked for. Not thread safe, each level is
+ * shrunk on the thread pool.
+ */
+class ImagePyramid
+{
+public:
+    /*!
+     * \brief level the image shrunk by 2^k both ways, made from level k-1 if it is not held
+     * \param image level 0, the image as it is at generation
+     * \param k from 0 up, 0 gives image back
+     */
+    const Bitmap& level(const Bitmap& image, uint64_t generation, int32_t k);
+
+    void clear();
+    // Levels held, not counting level 0
+    size_t levels() const{ return _levels.size(); }
+    // Bytes of pixels held
+    size_t bytes() const;
+
+private:
+    uint64_t _generation = 0;
+    // Level k at k-1
+    std::deque<Bitmap> _levels;
+
+    void follow(uint64_t generation);
+};
+
+#endif // IMAGEPYRAMID_H
@@ -11,6 +11,7 @@ MainWindow::MainWindow(QWidget *parent)
     createMenu();
     lQueued = new QLabel();
     updateProcessLabel(0);
+    lThroughput = new QLabel();
     createDisplayGroup();
     createFilterGroup();
     createSettingsGroup();
@@ -21,6 +22,7 @@ MainWindow::MainWindow(QWidget *parent)
     mainlayout->addWidget(gbSettings,0,1,1,1);
     mainlayout->addWidget(gbFilter,0,2,1,1);
     mainlayout->addWidget(lQueued,3,2,1,1);
+    mainlayout->addWidget(lThroughput,4,2,1,1);
 
     ui->setLayout(mainlayout);
     setWindowTitle(tr("Pixelater Qt2000"));
@@ -218,6 +220,7 @@ void MainWindow::createImageConnections(){
 
     connect(image, &ImageDisplay::imageLoaded,   this, &MainWindow::setLayoutHeight);
     connect(image, &ImageDisplay::processQueued, this, &MainWindow::updateProcessLabel);
+    connect(image, &ImageDisplay::chainProcessed, this, &MainWindow::updateThroughputLabel);
 
 }
 
@@ -243,3 +246,6 @@ void MainWindow::toggleBinary(){
 void MainWindow::updateProcessLabel(int _size){
     lQueued->setText(tr("Processes Queued: %1").arg(_size));
 }
+void MainWindow::updateThroughputLabel(int filters, double megapixels){
+    lThroughput->setText(tr("Last Filter Chain: %1 in one pass, %2 MP/s").arg(filters).arg(megapixels, 0, 'f', 1));
+}
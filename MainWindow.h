@@ -54,6 +54,7 @@ private:
     QLabel          *lIsovalue;
     QLabel          *lStepSize;
     QLabel          *lQueued;
+    QLabel          *lThroughput;
     QRadioButton    *rbBinary;
     QRadioButton    *rbGrayscale;
     QSlider         *sIsovalue;
@@ -74,6 +75,7 @@ private slots:
     void setIsoValue(){if(image){image->setIsovalue(sIsovalue->value());}}
     void setStepSize(){if(image){image->setStepSize(sStepsize->value());}}
     void updateProcessLabel(int);
+    void updateThroughputLabel(int, double);
 public slots:
     void updateIsoValue(int);
     void updateStepValue(int);
@@ -0,0 +1,68 @@
+#include "MappedFile.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Maps the entire file read only. Pages are only brought in as they are touched, so
+ * opening a large image costs next to nothing until the pixels are actually read.
+ * Throws FileMapException if the file can not be opened or mapped.
+ */
+MappedFile::MappedFile(const std::string& filename){
+#ifdef _WIN32
+    _file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if( _file == INVALID_HANDLE_VALUE )
+        throw FileMapException();
+    LARGE_INTEGER size;
+    if( !GetFileSizeEx(_file, &size) || size.QuadPart == 0 ){
+        CloseHandle(_file);
+        throw FileMapException();
+    }
+    _map = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if( !_map ){
+        CloseHandle(_file);
+        throw FileMapException();
+    }
+    _data = static_cast<const uint8_t*>(MapViewOfFile(_map, FILE_MAP_READ, 0, 0, 0));
+    if( !_data ){
+        CloseHandle(_map);
+        CloseHandle(_file);
+        throw FileMapException();
+    }
+    _size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if( fd < 0 )
+        throw FileMapException();
+    struct stat st;
+    if( fstat(fd, &st) != 0 || st.st_size == 0 ){
+        close(fd);
+        throw FileMapException();
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if( data == MAP_FAILED )
+        throw FileMapException();
+    // Filters and copies walk the pixels front to back
+    madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    _data = static_cast<const uint8_t*>(data);
+    _size = static_cast<size_t>(st.st_size);
+#endif
+}
+
+MappedFile::~MappedFile(){
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(_map);
+    CloseHandle(_file);
+#else
+    munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+}
@@ -0,0 +1,39 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <exception>
+
+/*
+ * Read-only view of a whole file mapped into memory. The mapping lives as long as
+ * the object does, so Bitmaps that read from it hold on to it with a shared_ptr.
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const{ return _data; }
+    size_t size() const{ return _size; }
+
+private:
+    const uint8_t* _data = nullptr;
+    size_t         _size = 0;
+#ifdef _WIN32
+    void*          _file = nullptr;
+    void*          _map  = nullptr;
+#endif
+};
+
+class FileMapException: public std::exception{
+    inline const char * what() const noexcept{
+        return "Could not map file into memory";
+    }
+};
+
+#endif // MAPPEDFILE_H
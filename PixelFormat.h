@@ -0,0 +1,81 @@
+#ifndef PIXELFORMAT_H
+#define PIXELFORMAT_H
+#include <cstdint>
+#include <utility>
+#include "PixelRow.h"
+
+/*
+ * The byte layout of a pixel fixed at compile time. R, G and B are the byte offsets of
+ * each color within a pixel, the same numbers rmask() and friends return at run time,
+ * and a 32 bit pixel keeps its alpha in whichever byte is left over.
+ *
+ * Filters are written once against a format and instantiated for every format a
+ * Bitmap can have, so the offsets are constants and nothing in the pixel loops
+ * depends on the file.
+ */
+template<uint32_t BPP, uint32_t R, uint32_t G, uint32_t B>
+struct PixelFormat
+{
+    static_assert( BPP == 3 || BPP == 4, "pixels are 24 or 32 bit" );
+    static_assert( R < BPP && G < BPP && B < BPP && R != G && G != B && R != B,
+                   "each color needs its own byte" );
+
+    static constexpr uint32_t bpp = BPP;
+    static constexpr uint32_t r = R;
+    static constexpr uint32_t g = G;
+    static constexpr uint32_t b = B;
+    static constexpr bool hasAlpha = BPP == 4;
+    static constexpr uint32_t a = hasAlpha ? 6 - R - G - B : 0;
+
+    // Row view with this format's pixel size
+    template<typename T>
+    using Row = PixelRow<T, BPP>;
+};
+
+// The layouts written by almost everything, BMP stores blue first
+typedef PixelFormat<3, 2, 1, 0> BGR24;
+typedef PixelFormat<4, 2, 1, 0> BGRA32;
+
+namespace pixelformat_detail {
+
+// Color offsets packed two bits each, red highest
+constexpr uint32_t key( uint32_t r, uint32_t g, uint32_t b ){ return r << 4 | g << 2 | b; }
+
+template<uint32_t BPP, uint32_t KEY, typename F>
+bool callIf( uint32_t key, F& f ){
+    constexpr uint32_t R = KEY >> 4, G = KEY >> 2 & 3, B = KEY & 3;
+    if constexpr( R < BPP && G < BPP && B < BPP && R != G && G != B && R != B ){
+        if( key == KEY ){
+            f( PixelFormat<BPP, R, G, B>{} );
+            return true;
+        }
+    }
+    return false;
+}
+
+template<uint32_t BPP, typename F, uint32_t... KEYS>
+bool dispatch( uint32_t key, F& f, std::integer_sequence<uint32_t, KEYS...> ){
+    return ( callIf<BPP, KEYS>(key, f) || ... );
+}
+
+} // namespace pixelformat_detail
+
+/*!
+ * \brief withFormat calls f once with the pixel format as a compile time type
+ * \param bpp bytes per pixel, anything other than 4 is treated as 3 like withDepth
+ * \param r,g,b byte offsets of the colors, every order setmask accepts is covered
+ * \param f generic callable taking a PixelFormat, use decltype(format) inside it
+ * \return false without calling f if the offsets do not describe a pixel
+ */
+template<typename F>
+bool withFormat( uint32_t bpp, uint32_t r, uint32_t g, uint32_t b, F&& f ){
+    using namespace pixelformat_detail;
+    if( r > 3 || g > 3 || b > 3 )
+        return false;
+    if( bpp == 4 ){
+        return dispatch<4>( key(r, g, b), f, std::make_integer_sequence<uint32_t, 64>{} );
+    }
+    return dispatch<3>( key(r, g, b), f, std::make_integer_sequence<uint32_t, 64>{} );
+}
+
+#endif // PIXELFORMAT_H
@@ -0,0 +1,54 @@
+#ifndef PIXELROW_H
+#define PIXELROW_H
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+
+/*
+ * A view of one row of pixels. Indexing hands back a pointer to the first byte of a
+ * pixel, add a channel offset (rmask() and friends) to get at a single color.
+ *
+ * BPP is the pixel size in bytes and is fixed at compile time so stepping through a
+ * row is a constant stride. Coordinates are only checked in debug builds.
+ */
+template<typename T, uint32_t BPP>
+class PixelRow
+{
+public:
+    static constexpr uint32_t bpp = BPP;
+
+    PixelRow(T* data, int32_t width):_data{data}, _width{width}{}
+
+    T* operator[](int32_t x) const{ assert( x >= 0 && x < _width ); return _data + x*BPP; }
+    T* data() const{ return _data; }
+    int32_t size() const{ return _width; }
+
+    // The bytes of the row without the padding, for copying whole rows
+    T* begin() const{ return _data; }
+    T* end() const{ return _data + _width*BPP; }
+
+private:
+    T*      _data;
+    int32_t _width;
+};
+
+// The two pixel sizes a Bitmap can have
+typedef std::integral_constant<uint32_t, 3> Depth24;
+typedef std::integral_constant<uint32_t, 4> Depth32;
+
+/*!
+ * \brief withDepth calls f once with the pixel size as a compile time constant
+ * \param bpp bytes per pixel, anything other than 4 is treated as 3
+ * \param f generic callable taking Depth24 or Depth32, use decltype(depth)::value
+ *        as the template argument to Bitmap::row
+ */
+template<typename F>
+void withDepth(uint32_t bpp, F&& f){
+    if( bpp == 4 ){
+        f(Depth32{});
+    }else{
+        f(Depth24{});
+    }
+}
+
+#endif // PIXELROW_H
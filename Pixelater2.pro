@@ -24,23 +24,56 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 CONFIG += c++17 O2
 
+# Pixel coordinates are only bounds checked in debug builds
+CONFIG(release, debug|release): DEFINES += NDEBUG
+
+# Let the compiler vectorize the per pixel loops, planar kernels depend on it
+!msvc {
+    QMAKE_CXXFLAGS_RELEASE -= -O2
+    QMAKE_CXXFLAGS_RELEASE += -O3
+}
+
 SOURCES += \
         main.cpp \
         MainWindow.cpp \
         ImageDisplay.cpp \
         bitmap.cpp \
-    BitmapIterator.cpp \
-    ImageProcessor.cpp
+    ImageProcessor.cpp \
+    MappedFile.cpp \
+    BitmapStream.cpp \
+    PlanarBitmap.cpp \
+    BufferPool.cpp \
+    PointOps.cpp \
+    Contours.cpp \
+    ContourCache.cpp \
+    ConvexHull.cpp \
+    ImagePyramid.cpp \
+    ThreadPool.cpp
 
 
 HEADERS += \
         MainWindow.h \
         ImageDisplay.h\
         bitmap.h \
+        PixelRow.h \
+        PixelFormat.h \
         point.hpp \
         jarvisMarch.hpp \
     BitmapIterator.h \
-    ImageProcessor.h
+    ImageProcessor.h \
+    MappedFile.h \
+    BitmapStream.h \
+    PlanarBitmap.h \
+    BufferPool.h \
+    PointOps.h \
+    SeparableBlur.hpp \
+    ThreadPool.h \
+    Contours.h \
+    ContourCache.h \
+    ConvexHull.h \
+    ImagePyramid.h \
+    CommandRing.hpp \
+    Tiling.hpp
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
@@ -0,0 +1,72 @@
+#include <algorithm>
+#include "PlanarBitmap.h"
+#include "SeparableBlur.hpp"
+
+void PlanarBitmap::fromInterleaved(const Bitmap& b){
+    _width  = b.width();
+    _height = b.height();
+    _count  = b.bpp();
+    r_mask  = b.rmask();
+    g_mask  = b.gmask();
+    b_mask  = b.bmask();
+    _stride = (size_t(_width) + PLANEALIGN - 1) / PLANEALIGN * PLANEALIGN;
+    for( uint32_t p = 0; p < _count; ++p ){
+        _planes[p].resize(_stride*_height);
+    }
+    for( uint32_t p = _count; p < 4; ++p ){
+        _planes[p] = Plane();
+    }
+
+    withDepth(_count, [&](auto depth){
+        constexpr uint32_t BPP = decltype(depth)::value;
+        for( int32_t y = 0; y < _height; ++y ){
+            const uint8_t* in = b.row<BPP>(y).data();
+            uint8_t* out[BPP];
+            for( uint32_t p = 0; p < BPP; ++p ){
+                out[p] = row(p, y);
+            }
+            for( int32_t x = 0; x < _width; ++x, in += BPP ){
+                for( uint32_t p = 0; p < BPP; ++p ){
+                    out[p][x] = in[p];
+                }
+            }
+        }
+    });
+}
+
+bool PlanarBitmap::fits(const Bitmap& b) const{
+    return b.width() == _width && b.height() == _height && b.bpp() == _count;
+}
+
+void PlanarBitmap::toInterleaved(Bitmap& b) const{
+    if( !fits(b) )
+        throw IncompatibleSizeException();
+
+    withDepth(_count, [&](auto depth){
+        constexpr uint32_t BPP = decltype(depth)::value;
+        for( int32_t y = 0; y < _height; ++y ){
+            uint8_t* out = b.row<BPP>(y).data();
+            const uint8_t* in[BPP];
+            for( uint32_t p = 0; p < BPP; ++p ){
+                in[p] = row(p, y);
+            }
+            for( int32_t x = 0; x < _width; ++x, out += BPP ){
+                for( uint32_t p = 0; p < BPP; ++p ){
+                    out[p] = in[p][x];
+                }
+            }
+        }
+    });
+}
+
+/*
+ * Same kernel and edge handling as blur(Bitmap&), one plane at a time
+ */
+void blur(PlanarBitmap& b, int32_t radius, Execution exec){
+    const int32_t w = b.width();
+    for( uint32_t c: { b.rmask(), b.gmask(), b.bmask() } ){
+        separableBlur<1>( w, b.height(), radius, exec,
+            [&b, c](int32_t y){ return b.row(c, y); },
+            [&b, c, w](int32_t y, const uint8_t* blurred){ copy_n( blurred, w, b.row(c, y) ); });
+    }
+}
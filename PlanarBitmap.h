@@ -0,0 +1,92 @@
+#ifndef PLANARBITMAP_H
+#define PLANARBITMAP_H
+#include <vector>
+#include <new>
+#include "bitmap.h"
+
+// Where in memory a filter would like the pixels to be
+enum class Layout{
+    Interleaved,    // Bitmap, BGR(A) pixels one after another as in the file
+    Planar          // PlanarBitmap, each channel in its own plane
+};
+
+/*
+ * Allocator handing out memory on an ALIGN byte boundary so plane rows line up with
+ * cache lines and vector registers.
+ */
+template<typename T, size_t ALIGN>
+struct AlignedAllocator{
+    typedef T value_type;
+    template<typename U> struct rebind{ typedef AlignedAllocator<U, ALIGN> other; };
+
+    AlignedAllocator() = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, ALIGN>&){}
+
+    T* allocate(size_t n){ return static_cast<T*>(::operator new(n*sizeof(T), std::align_val_t(ALIGN))); }
+    void deallocate(T* p, size_t){ ::operator delete(p, std::align_val_t(ALIGN)); }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U, ALIGN>&) const{ return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U, ALIGN>&) const{ return false; }
+};
+
+/*
+ * Structure of arrays copy of a Bitmap. Every byte position of a pixel gets its own
+ * plane, so plane rmask() holds the reds, and rows are padded out to PLANEALIGN
+ * bytes. Row y of a plane is row y of the bitmap as Bitmap::row() counts them, y = 0
+ * being the bottom of the picture. That is the order bottom up bitmaps store their
+ * rows in, so those are not flipped, only top down ones come out in reverse.
+ *
+ * Filters that only ever look at one channel at a time run over contiguous memory
+ * here instead of striding over the other channels.
+ */
+class PlanarBitmap
+{
+public:
+    static constexpr size_t PLANEALIGN = 64;
+    typedef std::vector<uint8_t, AlignedAllocator<uint8_t, PLANEALIGN>> Plane;
+
+    PlanarBitmap() = default;
+    explicit PlanarBitmap(const Bitmap& b){ fromInterleaved(b); }
+
+    // Splits b into planes, reusing the planes already allocated where possible
+    void fromInterleaved(const Bitmap& b);
+    // Writes the planes back into b, which must have the same dimensions and depth
+    void toInterleaved(Bitmap& b) const;
+    // Whether toInterleaved can write into b
+    bool fits(const Bitmap& b) const;
+
+    int32_t  width() const{ return _width; }
+    int32_t  height() const{ return _height; }
+    uint32_t planes() const{ return _count; }
+    size_t   stride() const{ return _stride; }
+    uint32_t rmask() const{ return r_mask; }
+    uint32_t gmask() const{ return g_mask; }
+    uint32_t bmask() const{ return b_mask; }
+
+    uint8_t* row(uint32_t plane, int32_t y){ return _planes[plane].data() + y*_stride; }
+    const uint8_t* row(uint32_t plane, int32_t y) const{ return _planes[plane].data() + y*_stride; }
+    Plane& plane(uint32_t plane){ return _planes[plane]; }
+    const Plane& plane(uint32_t plane) const{ return _planes[plane]; }
+
+private:
+    int32_t  _width  = 0;
+    int32_t  _height = 0;
+    size_t   _stride = 0;
+    uint32_t _count  = 0;
+    uint32_t r_mask  = 0;
+    uint32_t g_mask  = 0;
+    uint32_t b_mask  = 0;
+    Plane    _planes[4];
+};
+
+// Planar versions of filters from bitmap.h, same results as the interleaved ones
+void blur(PlanarBitmap& b, int32_t radius = BLURRADIUS, Execution exec = Execution::Parallel);
+vector<vector<pt>> findContours(const PlanarBitmap& o, int32_t isovalue, uint32_t step, bool useBinaryInterp,
+                                Execution exec = Execution::Parallel);
+vector<vector<vector<pt>>> findContours(const PlanarBitmap& o, const vector<int32_t>& isovalues, uint32_t step,
+                                        bool useBinaryInterp, Execution exec = Execution::Parallel);
+
+#endif // PLANARBITMAP_H
@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include "PointOps.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POINTOPS_X86
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+std::atomic<Isa>& activeIsa(){
+    static std::atomic<Isa> isa{ supportedIsa() };
+    return isa;
+}
+
+// Byte mask covering red, green and blue of a pixel held in a 32 bit lane
+inline uint32_t colorMask( const PointLayout& l ){
+    return 0xFFu << 8*l.r | 0xFFu << 8*l.g | 0xFFu << 8*l.b;
+}
+
+inline uint32_t alphaOffset( const PointLayout& l ){
+    return 6 - l.r - l.g - l.b;
+}
+
+/*
+ * Scalar kernels, the reference functions applied pixel by pixel. The vector kernels
+ * finish off their rows with these.
+ */
+template<uint32_t BPP>
+void grayscaleScalar( uint8_t* row, int32_t width, const PointLayout& l ){
+    for( int32_t x = 0; x < width; ++x, row += BPP ){
+        const uint8_t y = luminance( row[l.r], row[l.g], row[l.b] );
+        row[l.r] = y;
+        row[l.g] = y;
+        row[l.b] = y;
+    }
+}
+
+template<uint32_t BPP>
+void cellShadeScalar( uint8_t* row, int32_t width, const PointLayout& l ){
+    for( int32_t x = 0; x < width; ++x, row += BPP ){
+        row[l.r] = clip( row[l.r] );
+        row[l.g] = clip( row[l.g] );
+        row[l.b] = clip( row[l.b] );
+    }
+}
+
+template<uint32_t BPP>
+void binaryGrayScalar( uint8_t* row, int32_t width, const PointLayout& l, int32_t isovalue ){
+    const uint32_t a = alphaOffset(l);
+    for( int32_t x = 0; x < width; ++x, row += BPP ){
+        const uint8_t value = luminance( row[l.r], row[l.g], row[l.b] ) > isovalue ? 255 : 0;
+        row[l.r] = value;
+        row[l.g] = value;
+        row[l.b] = value;
+        if constexpr( BPP == 4 ){
+            row[a] = row[a] > isovalue ? 255 : 0;
+        }
+    }
+}
+
+#ifdef POINTOPS_X86
+
+/*
+ * SSE2, four pixels at a time with one pixel per 32 bit lane. The top byte of a 24 bit
+ * lane is junk and never stored.
+ */
+struct Lanes128{
+    __m128i r, g, b, a;     // Shift counts down to each channel
+    __m128i color;          // Red, green and blue bytes of each lane
+
+    TARGET_SSE2 explicit Lanes128( const PointLayout& l ):
+        r{ _mm_cvtsi32_si128(8*l.r) },
+        g{ _mm_cvtsi32_si128(8*l.g) },
+        b{ _mm_cvtsi32_si128(8*l.b) },
+        a{ _mm_cvtsi32_si128(8*alphaOffset(l)) },
+        color{ _mm_set1_epi32(int32_t(colorMask(l))) }
+    {}
+};
+
+// Four 24 bit pixels are read with one 16 byte load reaching four bytes past them
+template<uint32_t BPP>
+TARGET_SSE2 inline __m128i load4( const uint8_t* p ){
+    const __m128i raw = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p) );
+    if constexpr( BPP == 4 ){
+        return raw;
+    }else{
+        const __m128i lo = _mm_unpacklo_epi32( raw, _mm_srli_si128(raw, 3) );
+        const __m128i hi = _mm_unpacklo_epi32( _mm_srli_si128(raw, 6), _mm_srli_si128(raw, 9) );
+        return _mm_unpacklo_epi64( lo, hi );
+    }
+}
+
+// Stores exactly twelve bytes for 24 bit pixels, a store running into the next load
+// would stall it
+TARGET_SSE2 inline void store12( uint8_t* p, __m128i v ){
+    _mm_storel_epi64( reinterpret_cast<__m128i*>(p), v );
+    const uint32_t last = uint32_t( _mm_cvtsi128_si32( _mm_srli_si128(v, 8) ) );
+    memcpy( p + 8, &last, 4 );
+}
+
+// Packs 24 bit pixels back down
+template<uint32_t BPP>
+TARGET_SSE2 inline void store4( uint8_t* p, __m128i v ){
+    if constexpr( BPP == 4 ){
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(p), v );
+    }else{
+        const __m128i pixel = _mm_setr_epi32( 0xFFFFFF, 0, 0, 0 );
+        v = _mm_or_si128( _mm_or_si128( _mm_and_si128(v, pixel),
+                                        _mm_srli_si128(_mm_and_si128(v, _mm_slli_si128(pixel, 4)), 1) ),
+                          _mm_or_si128( _mm_srli_si128(_mm_and_si128(v, _mm_slli_si128(pixel, 8)), 2),
+                                        _mm_srli_si128(_mm_and_si128(v, _mm_slli_si128(pixel, 12)), 3) ) );
+        store12( p, v );
+    }
+}
+
+TARGET_SSE2 inline __m128i channel( __m128i px, __m128i shift ){
+    return _mm_and_si128( _mm_srl_epi32(px, shift), _mm_set1_epi32(0xFF) );
+}
+
+TARGET_SSE2 inline __m128i luminance4( __m128i px, const Lanes128& lanes ){
+    // Red and green share a lane so one multiply-add weighs both
+    const __m128i rg = _mm_or_si128( channel(px, lanes.r), _mm_slli_epi32(channel(px, lanes.g), 16) );
+    const __m128i n  = _mm_add_epi32( _mm_madd_epi16( rg, _mm_set1_epi32(1080 | 3576 << 16) ),
+                                      _mm_madd_epi16( channel(px, lanes.b), _mm_set1_epi32(361) ) );
+    // n / 5000 as n * 429497 >> 31, exact for every n up to 255 * 5017
+    const __m128i m    = _mm_set1_epi32(429497);
+    const __m128i even = _mm_srli_epi64( _mm_mul_epu32(n, m), 31 );
+    const __m128i odd  = _mm_srli_epi64( _mm_mul_epu32(_mm_srli_epi64(n, 32), m), 31 );
+    return _mm_or_si128( even, _mm_slli_epi64(odd, 32) );
+}
+
+// Copies the low byte of each lane into all four
+TARGET_SSE2 inline __m128i spread4( __m128i v ){
+    v = _mm_or_si128( v, _mm_slli_epi32(v, 8) );
+    return _mm_or_si128( v, _mm_slli_epi32(v, 16) );
+}
+
+template<uint32_t BPP>
+TARGET_SSE2 void grayscaleSSE2( uint8_t* row, int32_t width, const PointLayout& l ){
+    const Lanes128 lanes(l);
+    constexpr int32_t REACH = BPP == 4 ? 4 : 6;
+    int32_t x = 0;
+    for( ; x + REACH <= width; x += 4 ){
+        uint8_t* p = row + x*BPP;
+        const __m128i px = load4<BPP>(p);
+        const __m128i y  = spread4( luminance4(px, lanes) );
+        store4<BPP>( p, _mm_or_si128( _mm_and_si128(y, lanes.color), _mm_andnot_si128(lanes.color, px) ) );
+    }
+    grayscaleScalar<BPP>( row + x*BPP, width - x, l );
+}
+
+template<uint32_t BPP>
+TARGET_SSE2 void binaryGraySSE2( uint8_t* row, int32_t width, const PointLayout& l, int32_t isovalue ){
+    const Lanes128 lanes(l);
+    const __m128i iso = _mm_set1_epi32(isovalue);
+    constexpr int32_t REACH = BPP == 4 ? 4 : 6;
+    int32_t x = 0;
+    for( ; x + REACH <= width; x += 4 ){
+        uint8_t* p = row + x*BPP;
+        const __m128i px = load4<BPP>(p);
+        const __m128i on = _mm_cmpgt_epi32( luminance4(px, lanes), iso );
+        // The byte that is not a color is alpha on 32 bit pixels
+        const __m128i rest = BPP == 4 ? _mm_cmpgt_epi32( channel(px, lanes.a), iso ) : px;
+        store4<BPP>( p, _mm_or_si128( _mm_and_si128(on, lanes.color), _mm_andnot_si128(lanes.color, rest) ) );
+    }
+    binaryGrayScalar<BPP>( row + x*BPP, width - x, l, isovalue );
+}
+
+// clip() on sixteen bytes, unsigned compares done as signed ones with the top bit flipped
+TARGET_SSE2 inline __m128i clip16( __m128i v ){
+    const __m128i s   = _mm_xor_si128( v, _mm_set1_epi8(char(0x80)) );
+    const __m128i mid = _mm_cmpgt_epi8( s, _mm_set1_epi8(char(0x3F ^ 0x80)) );
+    const __m128i top = _mm_cmpgt_epi8( s, _mm_set1_epi8(char(0xBF ^ 0x80)) );
+    return _mm_or_si128( _mm_and_si128(mid, _mm_set1_epi8(char(0x80))), top );
+}
+
+template<uint32_t BPP>
+TARGET_SSE2 void cellShadeSSE2( uint8_t* row, int32_t width, const PointLayout& l ){
+    // Every byte of a 24 bit row is a color, 32 bit rows keep alpha
+    const __m128i color = BPP == 4 ? _mm_set1_epi32(int32_t(colorMask(l))) : _mm_set1_epi32(-1);
+    const size_t bytes = size_t(width)*BPP;
+    size_t i = 0;
+    for( ; i + 16 <= bytes; i += 16 ){
+        __m128i* p = reinterpret_cast<__m128i*>(row + i);
+        const __m128i v = _mm_loadu_si128(p);
+        _mm_storeu_si128( p, _mm_or_si128( _mm_and_si128(clip16(v), color), _mm_andnot_si128(color, v) ) );
+    }
+    if constexpr( BPP == 4 ){
+        cellShadeScalar<BPP>( row + i, width - int32_t(i/BPP), l );
+    }else{
+        for( ; i < bytes; ++i ){
+            row[i] = clip( row[i] );
+        }
+    }
+}
+
+/*
+ * AVX2, the same eight pixels at a time. 24 bit pixels are spread out of two
+ * overlapping 16 byte loads and packed back into two 12 byte stores.
+ */
+struct Lanes256{
+    __m128i r, g, b, a;
+    __m256i color;
+
+    TARGET_AVX2 explicit Lanes256( const PointLayout& l ):
+        r{ _mm_cvtsi32_si128(8*l.r) },
+        g{ _mm_cvtsi32_si128(8*l.g) },
+        b{ _mm_cvtsi32_si128(8*l.b) },
+        a{ _mm_cvtsi32_si128(8*alphaOffset(l)) },
+        color{ _mm256_set1_epi32(int32_t(colorMask(l))) }
+    {}
+};
+
+// Eight 24 bit pixels need 28 bytes, the last load runs one pixel and a byte past them
+template<uint32_t BPP>
+TARGET_AVX2 inline __m256i load8( const uint8_t* p ){
+    if constexpr( BPP == 4 ){
+        return _mm256_loadu_si256( reinterpret_cast<const __m256i*>(p) );
+    }else{
+        const __m128i lo = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p) );
+        const __m128i hi = _mm_loadu_si128( reinterpret_cast<const __m128i*>(p + 12) );
+        const __m256i raw = _mm256_inserti128_si256( _mm256_castsi128_si256(lo), hi, 1 );
+        const __m256i spread = _mm256_setr_epi8( 0, 1, 2, 3, 3, 4, 5, 6, 6, 7, 8, 9, 9, 10, 11, 12,
+                                                 0, 1, 2, 3, 3, 4, 5, 6, 6, 7, 8, 9, 9, 10, 11, 12 );
+        return _mm256_shuffle_epi8( raw, spread );
+    }
+}
+
+template<uint32_t BPP>
+TARGET_AVX2 inline void store8( uint8_t* p, __m256i v ){
+    if constexpr( BPP == 4 ){
+        _mm256_storeu_si256( reinterpret_cast<__m256i*>(p), v );
+    }else{
+        const __m256i pack = _mm256_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                               0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1 );
+        const __m256i packed = _mm256_shuffle_epi8(v, pack);
+        store12( p, _mm256_castsi256_si128(packed) );
+        store12( p + 12, _mm256_extracti128_si256(packed, 1) );
+    }
+}
+
+TARGET_AVX2 inline __m256i channel( __m256i px, __m128i shift ){
+    return _mm256_and_si256( _mm256_srl_epi32(px, shift), _mm256_set1_epi32(0xFF) );
+}
+
+TARGET_AVX2 inline __m256i luminance8( __m256i px, const Lanes256& lanes ){
+    const __m256i rg = _mm256_or_si256( channel(px, lanes.r), _mm256_slli_epi32(channel(px, lanes.g), 16) );
+    const __m256i n  = _mm256_add_epi32( _mm256_madd_epi16( rg, _mm256_set1_epi32(1080 | 3576 << 16) ),
+                                         _mm256_madd_epi16( channel(px, lanes.b), _mm256_set1_epi32(361) ) );
+    const __m256i m    = _mm256_set1_epi32(429497);
+    const __m256i even = _mm256_srli_epi64( _mm256_mul_epu32(n, m), 31 );
+    const __m256i odd  = _mm256_srli_epi64( _mm256_mul_epu32(_mm256_srli_epi64(n, 32), m), 31 );
+    return _mm256_or_si256( even, _mm256_slli_epi64(odd, 32) );
+}
+
+TARGET_AVX2 inline __m256i spread8( __m256i v ){
+    v = _mm256_or_si256( v, _mm256_slli_epi32(v, 8) );
+    return _mm256_or_si256( v, _mm256_slli_epi32(v, 16) );
+}
+
+template<uint32_t BPP>
+TARGET_AVX2 void grayscaleAVX2( uint8_t* row, int32_t width, const PointLayout& l ){
+    const Lanes256 lanes(l);
+    constexpr int32_t REACH = BPP == 4 ? 8 : 10;
+    int32_t x = 0;
+    for( ; x + REACH <= width; x += 8 ){
+        uint8_t* p = row + x*BPP;
+        const __m256i px = load8<BPP>(p);
+        const __m256i y  = spread8( luminance8(px, lanes) );
+        store8<BPP>( p, _mm256_or_si256( _mm256_and_si256(y, lanes.color), _mm256_andnot_si256(lanes.color, px) ) );
+    }
+    grayscaleSSE2<BPP>( row + x*BPP, width - x, l );
+}
+
+template<uint32_t BPP>
+TARGET_AVX2 void binaryGrayAVX2( uint8_t* row, int32_t width, const PointLayout& l, int32_t isovalue ){
+    const Lanes256 lanes(l);
+    const __m256i iso = _mm256_set1_epi32(isovalue);
+    constexpr int32_t REACH = BPP == 4 ? 8 : 10;
+    int32_t x = 0;
+    for( ; x + REACH <= width; x += 8 ){
+        uint8_t* p = row + x*BPP;
+        const __m256i px = load8<BPP>(p);
+        const __m256i on = _mm256_cmpgt_epi32( luminance8(px, lanes), iso );
+        const __m256i rest = BPP == 4 ? _mm256_cmpgt_epi32( channel(px, lanes.a), iso ) : px;
+        store8<BPP>( p, _mm256_or_si256( _mm256_and_si256(on, lanes.color), _mm256_andnot_si256(lanes.color, rest) ) );
+    }
+    binaryGraySSE2<BPP>( row + x*BPP, width - x, l, isovalue );
+}
+
+TARGET_AVX2 inline __m256i clip32( __m256i v ){
+    const __m256i s   = _mm256_xor_si256( v, _mm256_set1_epi8(char(0x80)) );
+    const __m256i mid = _mm256_cmpgt_epi8( s, _mm256_set1_epi8(char(0x3F ^ 0x80)) );
+    const __m256i top = _mm256_cmpgt_epi8( s, _mm256_set1_epi8(char(0xBF ^ 0x80)) );
+    return _mm256_or_si256( _mm256_and_si256(mid, _mm256_set1_epi8(char(0x80))), top );
+}
+
+template<uint32_t BPP>
+TARGET_AVX2 void cellShadeAVX2( uint8_t* row, int32_t width, const PointLayout& l ){
+    const __m256i color = BPP == 4 ? _mm256_set1_epi32(int32_t(colorMask(l))) : _mm256_set1_epi32(-1);
+    const size_t bytes = size_t(width)*BPP;
+    size_t i = 0;
+    for( ; i + 32 <= bytes; i += 32 ){
+        __m256i* p = reinterpret_cast<__m256i*>(row + i);
+        const __m256i v = _mm256_loadu_si256(p);
+        _mm256_storeu_si256( p, _mm256_or_si256( _mm256_and_si256(clip32(v), color), _mm256_andnot_si256(color, v) ) );
+    }
+    if constexpr( BPP == 4 ){
+        cellShadeSSE2<BPP>( row + i, width - int32_t(i/BPP), l );
+    }else{
+        for( ; i < bytes; ++i ){
+            row[i] = clip( row[i] );
+        }
+    }
+}
+
+#endif // POINTOPS_X86
+
+} // namespace
+
+Isa supportedIsa(){
+#ifdef POINTOPS_X86
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports("avx2") )
+        return Isa::AVX2;
+    if( __builtin_cpu_supports("sse2") )
+        return Isa::SSE2;
+#endif
+    return Isa::Scalar;
+}
+
+Isa pointOpsIsa(){
+    return activeIsa().load(std::memory_order_relaxed);
+}
+
+void setPointOpsIsa(Isa isa){
+    activeIsa().store( std::min(isa, supportedIsa()), std::memory_order_relaxed );
+}
+
+void grayscaleRow( uint8_t* row, int32_t width, const PointLayout& layout ){
+    withDepth(layout.bpp, [&](auto depth){
+        constexpr uint32_t BPP = decltype(depth)::value;
+        switch( pointOpsIsa() ){
+#ifdef POINTOPS_X86
+        case Isa::AVX2: grayscaleAVX2<BPP>(row, width, layout); break;
+        case Isa::SSE2: grayscaleSSE2<BPP>(row, width, layout); break;
+#endif
+        default:        grayscaleScalar<BPP>(row, width, layout); break;
+        }
+    });
+}
+
+void cellShadeRow( uint8_t* row, int32_t width, const PointLayout& layout ){
+    withDepth(layout.bpp, [&](auto depth){
+        constexpr uint32_t BPP = decltype(depth)::value;
+        switch( pointOpsIsa() ){
+#ifdef POINTOPS_X86
+        case Isa::AVX2: cellShadeAVX2<BPP>(row, width, layout); break;
+        case Isa::SSE2: cellShadeSSE2<BPP>(row, width, layout); break;
+#endif
+        default:        cellShadeScalar<BPP>(row, width, layout); break;
+        }
+    });
+}
+
+void binaryGrayRow( uint8_t* row, int32_t width, const PointLayout& layout, int32_t isovalue ){
+    withDepth(layout.bpp, [&](auto depth){
+        constexpr uint32_t BPP = decltype(depth)::value;
+        switch( pointOpsIsa() ){
+#ifdef POINTOPS_X86
+        case Isa::AVX2: binaryGrayAVX2<BPP>(row, width, layout, isovalue); break;
+        case Isa::SSE2: binaryGraySSE2<BPP>(row, width, layout, isovalue); break;
+#endif
+        default:        binaryGrayScalar<BPP>(row, width, layout, isovalue); break;
+        }
+    });
+}
+
+void PointChain::append(PointOp op, int32_t isovalue){
+    ++_filters;
+    const PointOp last = _steps.empty() ? op : _steps.back().op;
+    if( !_steps.empty() ){
+        if( op == PointOp::Grayscale && (last == PointOp::Grayscale || last == PointOp::BinaryGray) )
+            return;
+        if( op == PointOp::CellShade && (last == PointOp::CellShade || last == PointOp::BinaryGray) )
+            return;
+        // binaryGray takes the luminance itself and grayscale leaves the luminance as it is
+        if( op == PointOp::BinaryGray && last == PointOp::Grayscale )
+            _steps.pop_back();
+    }
+    _steps.push_back( PointStep{ op, isovalue } );
+}
+
+void PointChain::apply( uint8_t* row, int32_t width, const PointLayout& layout ) const{
+    for( int32_t x = 0; x < width; x += POINTCHUNK ){
+        uint8_t* chunk = row + size_t(x)*layout.bpp;
+        const int32_t n = std::min( POINTCHUNK, width - x );
+        for( const PointStep& step: _steps ){
+            switch( step.op ){
+            case PointOp::Grayscale:  grayscaleRow( chunk, n, layout ); break;
+            case PointOp::CellShade:  cellShadeRow( chunk, n, layout ); break;
+            case PointOp::BinaryGray: binaryGrayRow( chunk, n, layout, step.isovalue ); break;
+            }
+        }
+    }
+}
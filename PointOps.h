@@ -0,0 +1,120 @@
+#ifndef POINTOPS_H
+#define POINTOPS_H
+#include <cstdint>
+#include <vector>
+#include "PixelFormat.h"
+
+/*
+ * Row kernels for the filters that look at one pixel at a time: grayscale, cellShade
+ * and binaryGray. Each comes in a scalar, an SSE2 and an AVX2 version, the fastest one
+ * the processor supports is picked once at start up.
+ *
+ * All versions give exactly the output of the reference functions below, for every
+ * pixel layout withFormat knows about.
+ */
+
+// Instruction sets the kernels are written for, in increasing order
+enum class Isa{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+// Best instruction set this processor supports, from cpuid
+Isa supportedIsa();
+// Instruction set the kernels currently run on, supportedIsa() unless changed
+Isa pointOpsIsa();
+// Forces the kernels down to isa, anything above supportedIsa() is clamped to it
+void setPointOpsIsa(Isa isa);
+
+/*
+ * Luminance reference. The weights are 0.216, 0.7152 and 0.0722, the result is the
+ * exact weighted sum rounded down:
+ *
+ *     y = floor( (2160*r + 7152*g + 722*b) / 10000 )
+ *
+ * (Plain double arithmetic lands just under the integer in about one in sixteen
+ * thousand colors where the sum is exact, this is the value it was meant to give.)
+ */
+inline uint8_t luminance( uint8_t r, uint8_t g, uint8_t b ){
+    return ( 1080u*r + 3576u*g + 361u*b ) / 5000u;
+}
+
+/*
+ * Cell shade reference, one of three levels depending on where value lies
+ * [0x00,0x40) -> 0x00, [0x40,0xC0) -> 0x80, [0xC0,0xFF] -> 0xFF
+ */
+inline uint8_t clip( uint8_t value )noexcept{
+    return (value < 0x40 ? 0x00 : (value < 0xC0 ? 0x80 : 0xFF ) );
+}
+
+// Byte offsets of a pixel layout as the kernels take them, alpha is whatever is left
+struct PointLayout{
+    uint32_t bpp;
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+};
+
+template<typename F>
+constexpr PointLayout pointLayout(){
+    return PointLayout{ F::bpp, F::r, F::g, F::b };
+}
+
+/*!
+ * \brief grayscaleRow sets red, green and blue of each pixel to its luminance
+ * \param row first byte of the row
+ * \param width pixels in the row
+ */
+void grayscaleRow( uint8_t* row, int32_t width, const PointLayout& layout );
+// Applies clip() to red, green and blue of each pixel
+void cellShadeRow( uint8_t* row, int32_t width, const PointLayout& layout );
+/*!
+ * \brief binaryGrayRow sets the colors of each pixel to 255 if its luminance is above
+ *        isovalue and 0 otherwise, alpha of 32 bit pixels is thresholded directly
+ */
+void binaryGrayRow( uint8_t* row, int32_t width, const PointLayout& layout, int32_t isovalue );
+
+// The filters above, as steps of a PointChain
+enum class PointOp{
+    Grayscale,
+    CellShade,
+    BinaryGray
+};
+
+struct PointStep{
+    PointOp op;
+    int32_t isovalue;
+};
+
+/*
+ * A run of point filters applied in one pass. Each row is taken POINTCHUNK pixels at a
+ * time through every step while those pixels are still in cache, instead of sweeping
+ * the whole image once per filter.
+ *
+ * append() leaves out steps that cannot change anything given the ones before them:
+ * grayscale is a no-op after grayscale or binaryGray, cellShade after cellShade or
+ * binaryGray, and binaryGray does not need the grayscale in front of it. The output is
+ * the same as running every filter appended in order.
+ */
+class PointChain{
+public:
+    static constexpr int32_t POINTCHUNK = 1024;
+
+    void append(PointOp op, int32_t isovalue = 0);
+    void clear(){ _steps.clear(); _filters = 0; }
+
+    bool empty() const{ return _steps.empty(); }
+    const std::vector<PointStep>& steps() const{ return _steps; }
+    // Filters appended, including any that were left out
+    int32_t filters() const{ return _filters; }
+
+    // Runs every step over one row
+    void apply( uint8_t* row, int32_t width, const PointLayout& layout ) const;
+
+private:
+    std::vector<PointStep> _steps;
+    int32_t _filters = 0;
+};
+
+#endif // POINTOPS_H
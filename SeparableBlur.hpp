@@ -0,0 +1,136 @@
+#ifndef SEPARABLEBLUR_HPP
+#define SEPARABLEBLUR_HPP
+#include <algorithm>
+#include <vector>
+#include "bitmap.h"
+#include "Tiling.hpp"
+
+/*
+ * The binomial blur both layouts share. The kernel is the outer product of row 2r of
+ * Pascal's triangle with itself, which splits into a horizontal pass and a vertical
+ * pass over the same weights. Keeping the horizontal sums whole means the result is
+ * exactly the one the full 2D kernel gives.
+ *
+ * Each band of rows keeps a ring of the 2r+1 most recent horizontally blurred rows,
+ * every source row is padded and filtered once, and the vertical pass reads the ring.
+ * The image is blurred in place: a band only overwrites rows it has already read, and
+ * the rows it borrows from its neighbours are copied before any band starts.
+ */
+
+// Row 2*radius of Pascal's triangle, sums to 2^(2*radius)
+inline std::vector<uint32_t> binomialWeights(int32_t radius){
+    std::vector<uint32_t> weights(2*radius + 1, 1);
+    for( int32_t n = 1; n <= 2*radius; ++n ){
+        for( int32_t k = n - 1; k > 0; --k ){
+            weights[k] += weights[k-1];
+        }
+    }
+    return weights;
+}
+
+// Rows of output per band handed to a thread
+const int32_t BLURBAND = 64;
+
+/*!
+ * \brief separableBlur blurs every sample of an image in place
+ * \param SPP samples per pixel, the horizontal pass steps over this many bytes
+ * \param width pixels per row
+ * \param height rows
+ * \param row row(y) gives a pointer to row y, it is read and later written through
+ * \param store store(y, blurred) writes the blurred samples of row y back, leaving out
+ *        any it should not touch
+ */
+template<uint32_t SPP, typename ROW, typename STORE>
+void separableBlur(int32_t width, int32_t height, int32_t radius, Execution exec, ROW row, STORE store){
+    if( radius < 1 || radius > MAXBLURRADIUS )
+        throw InvalidRadiusException();
+    if( width <= 0 || height <= 0 )
+        return;
+
+    const std::vector<uint32_t> weights = binomialWeights(radius);
+    const int32_t taps  = 2*radius + 1;
+    const int32_t shift = 4*radius;
+    const size_t  samples = size_t(width)*SPP;
+
+    typedef std::vector<std::pair<int32_t, std::vector<uint8_t>>> Borrowed;
+    const std::vector<Tile> bands = rowBands( width, height, BLURBAND );
+    // Rows in the halo of each band, taken from its neighbours before anything is written
+    std::vector<Borrowed> borrowed( bands.size() );
+    if( bands.size() > 1 ){
+        for( size_t i = 0; i < bands.size(); ++i ){
+            const Tile reach = bands[i].withHalo( radius, width, height );
+            for( int32_t y = reach.y0; y < reach.y1; ++y ){
+                if( y >= bands[i].y0 && y < bands[i].y1 )
+                    continue;
+                const uint8_t* from = row(y);
+                borrowed[i].emplace_back( y, std::vector<uint8_t>( from, from + samples ) );
+            }
+        }
+    }
+
+    forEachTile( bands, exec, [&](const Tile& tile){
+        const int32_t first = tile.y0;
+        const int32_t last  = tile.y1;
+        const Borrowed& rows = borrowed[first / BLURBAND];
+
+        std::vector<uint8_t>  padded( size_t(width + 2*radius)*SPP );
+        std::vector<uint32_t> ring( taps*samples );
+        std::vector<uint32_t> sum( samples );
+        std::vector<uint8_t>  out( samples );
+
+        auto source = [&](int32_t y)->const uint8_t*{
+            y = std::clamp( y, 0, height - 1 );
+            if( y >= first && y < last )
+                return row(y);
+            for( auto& b: rows ){
+                if( b.first == y )
+                    return b.second.data();
+            }
+            return row(y);
+        };
+
+        // Horizontal pass of row y into its slot of the ring, edge pixels repeated
+        auto horizontal = [&](int32_t y){
+            const uint8_t* in = source(y);
+            uint8_t* p = padded.data();
+            for( int32_t k = 0; k < radius; ++k, p += SPP ){
+                std::copy_n( in, SPP, p );
+            }
+            p = std::copy_n( in, samples, p );
+            for( int32_t k = 0; k < radius; ++k, p += SPP ){
+                std::copy_n( in + samples - SPP, SPP, p );
+            }
+
+            uint32_t* h = ring.data() + size_t( (y - first + taps) % taps )*samples;
+            std::fill_n( h, samples, 0 );
+            for( int32_t k = 0; k < taps; ++k ){
+                const uint32_t w = weights[k];
+                const uint8_t* tap = padded.data() + size_t(k)*SPP;
+                for( size_t i = 0; i < samples; ++i ){
+                    h[i] += w * tap[i];
+                }
+            }
+        };
+
+        for( int32_t y = first - radius; y < first + radius; ++y ){
+            horizontal(y);
+        }
+        for( int32_t j = first; j < last; ++j ){
+            horizontal(j + radius);
+            std::fill( sum.begin(), sum.end(), 0 );
+            for( int32_t k = 0; k < taps; ++k ){
+                const uint32_t w = weights[k];
+                const uint32_t* h = ring.data() + size_t( (j - radius + k - first + taps) % taps )*samples;
+                for( size_t i = 0; i < samples; ++i ){
+                    sum[i] += w * h[i];
+                }
+            }
+            for( size_t i = 0; i < samples; ++i ){
+                out[i] = uint8_t( sum[i] >> shift );
+            }
+            store(j, out.data());
+        }
+    });
+}
+
+#endif // SEPARABLEBLUR_HPP
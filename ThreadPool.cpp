@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <exception>
+#include "ThreadPool.h"
+
+namespace {
+// Which pool the current thread works for and the queue it owns there
+thread_local const ThreadPool* workerPool = nullptr;
+thread_local size_t workerQueue = 0;
+}
+
+// One call to run(), lives on the caller's stack until every task has finished
+struct ThreadPool::Job{
+    const std::function<void(size_t)>* task;
+    size_t remaining;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+ThreadPool& ThreadPool::instance(){
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::ThreadPool(unsigned threads){
+    start(threads);
+}
+
+ThreadPool::~ThreadPool(){
+    stop();
+}
+
+void ThreadPool::setThreadCount(unsigned threads){
+    stop();
+    start(threads);
+}
+
+void ThreadPool::start(unsigned threads){
+    if( threads == 0 )
+        threads = std::max( 1u, std::thread::hardware_concurrency() );
+    _threads = threads;
+    _stop = false;
+    _queues.clear();
+    for( unsigned i = 0; i < threads; ++i ){
+        _queues.push_back( std::make_unique<Queue>() );
+    }
+    for( unsigned i = 0; i + 1 < threads; ++i ){
+        _workers.emplace_back( [this, i]{ work(i); } );
+    }
+}
+
+void ThreadPool::stop(){
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for( auto& worker: _workers ){
+        worker.join();
+    }
+    _workers.clear();
+}
+
+size_t ThreadPool::self() const{
+    return workerPool == this ? workerQueue : _queues.size() - 1;
+}
+
+void ThreadPool::work(size_t self){
+    workerPool  = this;
+    workerQueue = self;
+    Task task;
+    for(;;){
+        if( take(self, task) ){
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _wake.wait( lock, [this]{ return _stop || _pending.load() > 0; } );
+        if( _stop )
+            return;
+    }
+}
+
+/*
+ * Next task for the thread owning queue self: the front of its own queue, otherwise
+ * the back of the first other queue that has anything
+ */
+bool ThreadPool::take(size_t self, Task& task){
+    const size_t n = _queues.size();
+    for( size_t k = 0; k < n; ++k ){
+        Queue& q = *_queues[(self + k) % n];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if( q.tasks.empty() )
+            continue;
+        if( k == 0 ){
+            task = q.tasks.front();
+            q.tasks.pop_front();
+        }else{
+            task = q.tasks.back();
+            q.tasks.pop_back();
+        }
+        --_pending;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::execute(const Task& task){
+    Job& job = *task.job;
+    std::exception_ptr error;
+    try{
+        (*job.task)(task.index);
+    }catch(...){
+        error = std::current_exception();
+    }
+    // The caller may return as soon as remaining reaches 0, so job is not touched
+    // again once the lock is let go
+    std::lock_guard<std::mutex> lock(job.mutex);
+    if( error && !job.error )
+        job.error = error;
+    if( --job.remaining == 0 )
+        job.done.notify_all();
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)>& task){
+    if( count == 0 )
+        return;
+    if( _threads == 1 || count == 1 ){
+        for( size_t i = 0; i < count; ++i ){
+            task(i);
+        }
+        return;
+    }
+
+    Job job;
+    job.task = &task;
+    job.remaining = count;
+
+    // Counted before they are queued so a thread taking one never sees fewer than none
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending += count;
+    }
+    // Consecutive tasks go to the same queue, the caller's share first
+    const size_t me = self();
+    const size_t n  = _queues.size();
+    for( size_t k = 0; k < n; ++k ){
+        Queue& q = *_queues[(me + k) % n];
+        const size_t first = count * k / n;
+        const size_t last  = count * (k + 1) / n;
+        std::lock_guard<std::mutex> lock(q.mutex);
+        for( size_t i = first; i < last; ++i ){
+            q.tasks.push_back( Task{ &job, i } );
+        }
+    }
+    _wake.notify_all();
+
+    // Help out with anything queued, this job's tasks or not, until this job is done
+    Task next;
+    for(;;){
+        {
+            std::unique_lock<std::mutex> lock(job.mutex);
+            if( job.remaining == 0 )
+                break;
+        }
+        if( take(me, next) ){
+            execute(next);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(job.mutex);
+        job.done.wait( lock, [&job]{ return job.remaining == 0; } );
+        break;
+    }
+    if( job.error )
+        std::rethrow_exception(job.error);
+}
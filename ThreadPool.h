@@ -0,0 +1,74 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Threads the filters share. run() deals the tasks out evenly over one queue per
+ * thread, each thread works through its own queue from the front and, once that is
+ * empty, steals from the back of the others'. The thread calling run() takes a share
+ * too and keeps working until every task is done, so a task may itself call run().
+ *
+ * Tasks have to write to separate parts of the output. Then which thread runs a task
+ * makes no difference to the result, and neither does the number of threads.
+ */
+class ThreadPool
+{
+public:
+    // The pool the filters run on
+    static ThreadPool& instance();
+
+    // threads counts the caller of run(), 0 is one per core
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Threads that work on a run(), the caller included, 1 runs everything in the caller
+    unsigned threadCount() const{ return _threads; }
+    // Stops the workers and starts threads - 1 new ones, not while anything is running
+    void setThreadCount(unsigned threads);
+
+    /*!
+     * \brief run calls task(i) for each i in [0,count) and returns when all are done
+     * \throws the first exception a task threw, once all the others have finished
+     */
+    void run(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    struct Job;
+    struct Task{
+        Job*   job;
+        size_t index;
+    };
+    struct Queue{
+        std::mutex        mutex;
+        std::deque<Task>  tasks;
+    };
+
+    unsigned _threads = 1;
+    std::vector<std::thread> _workers;
+    // One queue per worker, the last is shared by callers from outside the pool
+    std::vector<std::unique_ptr<Queue>> _queues;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::atomic<size_t> _pending{0};
+    bool _stop = false;
+
+    void start(unsigned threads);
+    void stop();
+    void work(size_t self);
+    size_t self() const;
+    bool take(size_t self, Task& task);
+    void execute(const Task& task);
+};
+
+#endif // THREADPOOL_H
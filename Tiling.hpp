@@ -0,0 +1,65 @@
+#ifndef TILING_HPP
+#define TILING_HPP
+#include <algorithm>
+#include <vector>
+#include "bitmap.h"
+#include "ThreadPool.h"
+
+/*
+ * Cutting an image into pieces for the thread pool. How an image is cut depends only
+ * on its size and the piece size asked for, never on the number of threads, and every
+ * output pixel belongs to exactly one piece.
+ */
+
+// Rectangle [x0,x1) x [y0,y1) in pixels, y counted the same way as row(y)
+struct Tile{
+    int32_t x0, y0, x1, y1;
+
+    int32_t width() const{ return x1 - x0; }
+    int32_t height() const{ return y1 - y0; }
+
+    // The area a filter reaching halo pixels past the tile reads, cut off at the image
+    Tile withHalo(int32_t halo, int32_t imageWidth, int32_t imageHeight) const{
+        return Tile{ std::max( x0 - halo, 0 ), std::max( y0 - halo, 0 ),
+                     std::min( x1 + halo, imageWidth ), std::min( y1 + halo, imageHeight ) };
+    }
+};
+
+// Rows of a band handed to one task by the filters that work a row at a time
+const int32_t BANDROWS = 32;
+
+// Full width bands of rows rows each, the last one may be shorter
+inline std::vector<Tile> rowBands(int32_t width, int32_t height, int32_t rows = BANDROWS){
+    std::vector<Tile> bands;
+    for( int32_t y = 0; y < height; y += rows ){
+        bands.push_back( Tile{ 0, y, width, std::min( y + rows, height ) } );
+    }
+    return bands;
+}
+
+// tileWidth x tileHeight tiles, left to right and then down, cut short at the edges
+inline std::vector<Tile> tiles(int32_t width, int32_t height, int32_t tileWidth, int32_t tileHeight){
+    std::vector<Tile> all;
+    for( int32_t y = 0; y < height; y += tileHeight ){
+        for( int32_t x = 0; x < width; x += tileWidth ){
+            all.push_back( Tile{ x, y, std::min( x + tileWidth, width ), std::min( y + tileHeight, height ) } );
+        }
+    }
+    return all;
+}
+
+/*!
+ * \brief forEachTile calls f(tile) for every tile, on the thread pool when Parallel
+ */
+template<typename F>
+void forEachTile(const std::vector<Tile>& pieces, Execution exec, F&& f){
+    if( exec == Execution::Parallel ){
+        ThreadPool::instance().run( pieces.size(), [&](size_t i){ f(pieces[i]); } );
+    }else{
+        for( const Tile& tile: pieces ){
+            f(tile);
+        }
+    }
+}
+
+#endif // TILING_HPP
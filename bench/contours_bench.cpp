@@ -0,0 +1,208 @@
+/*
+ * Micro-benchmark for the marching squares cell loop. Counts the heap allocations and
+ * time of finding the cells a contour goes through, first the way it used to be done,
+ * a vector from edges(), the old table kept below, for every cell, then with
+ * contourCells() and its case table, and last the whole of marchingSquares.
+ *
+ *     make bench
+ *     bench/contours_bench [image.bmp] [step] [isovalue]
+ *
+ * Without an image a 4096x4096 field of rings is used.
+ */
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "../bitmap.h"
+#include "../Contours.h"
+
+namespace {
+std::atomic<size_t> allocations{0};
+}
+
+void* operator new(size_t size){
+    ++allocations;
+    if( void* p = malloc(size ? size : 1) )
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept{ free(p); }
+void operator delete(void* p, size_t) noexcept{ free(p); }
+
+namespace {
+
+struct Field{
+    uint32_t width, height;
+    vector<uint8_t> above;  // 1 above the isovalue
+};
+
+Field rings(uint32_t size){
+    Field f{ size, size, vector<uint8_t>(size_t(size)*size) };
+    for( uint32_t y = 0; y < size; ++y ){
+        for( uint32_t x = 0; x < size; ++x ){
+            const double r = std::hypot( double(x) - size/2.0, double(y) - size/2.0 );
+            f.above[size_t(y)*size + x] = std::sin(r / 3.0) + 0.3*std::sin(x*0.11)*std::cos(y*0.07) > 0;
+        }
+    }
+    return f;
+}
+
+Field threshold(const Bitmap& b, int32_t isovalue){
+    Field f{ uint32_t(b.width()), uint32_t(b.height()), vector<uint8_t>(size_t(b.width())*b.height()) };
+    withFormat(b, [&](auto format){
+        typedef decltype(format) F;
+        constexpr uint32_t BPP = F::bpp;
+        for( uint32_t y = 0; y < f.height; ++y ){
+            auto row = b.row<BPP>(y);
+            for( uint32_t x = 0; x < f.width; ++x ){
+                const uint8_t* pixel = row[x];
+                f.above[size_t(y)*f.width + x] = luminance( pixel[F::r], pixel[F::g], pixel[F::b] ) > isovalue;
+            }
+        }
+    });
+    return f;
+}
+
+/*
+ * The idea here is to return a set of a pair of edges. Why this isn't just a pair of
+ * edges is due to the ambiguous case where there are two possible pairs of edges.
+ * We'll define an edge as two vertices, (v,v')
+ *
+ * We want to map from the unit square to the square at (i,j), but our table will only
+ * return the unit square edges, we'll do the mapping after calling edges.
+ *
+ * This is the table the tracer used before CASES, kept here as the baseline.
+ */
+vector<pair<edge,edge>> edges( uint8_t square ){
+    vector<pair<edge,edge>> sides;
+    switch( square ){
+    case 1:                                             /* ********************/
+    case 14:                                            // Bottom, Left       */
+        sides = { make_pair( edge( pt(0,0),pt(0,1) ),   // +==+               */
+                             edge( pt(0,0),pt(1,0) )    // |  |               */
+                           )                            // -==+               */
+                };                                      /* ********************/
+        break;
+
+    case 2:                                             /* ********************/
+    case 13:                                            //  Bottom, Right     */
+        sides = { make_pair( edge( pt(0,0),pt(1,0) ),   // +==+               */
+                             edge( pt(1,0),pt(1,1) )    // |  |               */
+                           )                            // +==-               */
+                };                                      /* ********************/
+        break;
+
+    case 3:                                             /* ********************/
+    case 12:                                            // Left, Right        */
+        sides = { make_pair( edge( pt(0,0),pt(0,1) ),   // +==+               */
+                             edge( pt(1,0),pt(1,1) )    // |  |               */
+                           )                            // -==-               */
+                };                                      /* ********************/
+        break;
+
+    case 4:                                             /* ********************/
+    case 11:                                            // Top, Right         */
+        sides = { make_pair( edge( pt(0,1),pt(1,1) ),   // +==-               */
+                             edge( pt(1,0),pt(1,1) )    // |  |               */
+                           )                            // +==+               */
+                };                                      /* ********************/
+        break;
+
+    case 5:                                             /* ******************************/
+    case 10:                                            // {Top, Right}, {Bottom, Left} */
+        sides = { make_pair( edge( pt(0,1),pt(1,1) ),   // -==+                         */
+                             edge( pt(1,1),pt(1,0) )    // |  |                         */
+                           ),                           // +==-                         */
+                  make_pair( edge( pt(0,0),pt(0,1) ),   /* ******************************/
+                             edge( pt(0,0),pt(1,0) )
+                           )
+                };
+        break;
+
+    case 6:                                             /* ********************/
+    case 9:                                             // {Top, Bottom}      */
+        sides = { make_pair( edge( pt(0,1),pt(1,1) ),   // +==-               */
+                             edge( pt(0,0),pt(1,0) )    // |  |               */
+                           )                            // +==-               */
+                };                                      /* ********************/
+        break;
+
+    case 7:                                             /* ********************/
+    case 8:                                             // {Top, Left}        */
+        sides = { make_pair( edge( pt(0,1),pt(1,1) ),   // +==-               */
+                             edge( pt(0,0),pt(0,1) )    // |  |               */
+                           )                            // -==-               */
+                };                                      /* *********************/
+        break;
+    /* **********************
+     * None
+     ***********************/
+    case 0:
+    case 15:
+    default:
+        break;
+    }
+    return sides;
+}
+
+// The cell loop before the case table, one vector from edges() per cell
+size_t legacyCells(const Field& f, uint32_t step){
+    const uint8_t* field = f.above.data();
+    const uint32_t w = f.width;
+    auto value = [&](const pt& p)->point_t{ return field[size_t(p.y)*w + size_t(p.x)]; };
+    vector<ContourCell> cells;
+    for( uint32_t j = 0; j + step < f.height; j += step ){
+        for( uint32_t i = 0; i + step < w; i += step ){
+            const uint8_t square = field[size_t(j)*w + i] | field[size_t(j)*w + i + step] << 1
+                                 | field[size_t(j+step)*w + i + step] << 2 | field[size_t(j+step)*w + i] << 3;
+            if( square == 0 || square == 15 )
+                continue;
+            auto v = edges(square).front();
+            edge a = make_edge<point_t>( pt(i,j)+(v.first.first)*step,  pt(i,j)+(v.first.second)*step );
+            edge b = make_edge<point_t>( pt(i,j)+(v.second.first)*step, pt(i,j)+(v.second.second)*step );
+            cells.push_back( ContourCell{ pt(i,j),
+                                          interpolation(a.first, a.second, value(a.first), value(a.second), 0),
+                                          interpolation(b.first, b.second, value(b.first), value(b.second), 0) } );
+        }
+    }
+    return cells.size();
+}
+
+template<typename F>
+void measure(const char* name, F&& f){
+    const size_t before = allocations.load();
+    const auto start = std::chrono::steady_clock::now();
+    const size_t count = f();
+    const double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    printf( "%-18s %10zu %14zu %10.2f\n", name, count, allocations.load() - before, ms );
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+    const uint32_t step    = argc > 2 ? uint32_t(atoi(argv[2])) : 1;
+    const int32_t isovalue = argc > 3 ? atoi(argv[3]) : ISOVALUE;
+    Field f;
+    if( argc > 1 ){
+        Bitmap image;
+        loadBitmap(image, argv[1]);
+        f = threshold(image, isovalue);
+    }else{
+        f = rings(4096);
+    }
+    const ContourSamples samples{ f.above.data(), ptrdiff_t(f.width), 1 };
+
+    printf( "%ux%u step %u\n", f.width, f.height, step );
+    printf( "%-18s %10s %14s %10s\n", "", "cells", "allocations", "ms" );
+    measure( "edges() per cell", [&]{ return legacyCells(f, step); } );
+    measure( "contourCells", [&]{
+        return contourCells(f.above.data(), f.width, f.height, f.width, step, samples).size();
+    });
+    printf( "%-18s %10s\n", "", "polygons" );
+    measure( "marchingSquares", [&]{
+        return marchingSquares(f.above.data(), f.width, f.height, f.width, step, samples, Execution::Serial).size();
+    });
+    return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Benchmark for the convex hulls of contours. Times grahamScan and jarvisMarch from
+ * jarvisMarch.hpp against convexHull on random points in a disk, 10^3 to 10^7 of them,
+ * and counts the points each hull leaves outside, which only an exact hull never does.
+ * Then hulls every contour of an image the old way, a copy of each polygon through
+ * grahamScan, and with convexHulls serial and parallel.
+ *
+ *     make bench
+ *     bench/hull_bench [image.bmp] [step] [isovalue]
+ *
+ * jarvisMarch takes time proportional to the points times the hull, it is only run up
+ * to 10^5 points. Without an image test.bmp is contoured.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "../bitmap.h"
+#include "../ConvexHull.h"
+#include "../jarvisMarch.hpp"
+
+namespace {
+
+vector<pt> disk(size_t n, std::mt19937_64& random){
+    std::uniform_real_distribution<double> unit(0, 1);
+    vector<pt> points(n);
+    for( auto& p: points ){
+        const double r = 1000 * std::sqrt(unit(random));
+        const double a = 2 * M_PI * unit(random);
+        p = pt( 1000 + r*std::cos(a), 1000 + r*std::sin(a) );
+    }
+    return points;
+}
+
+// Points strictly outside hull, whichever way round it goes
+size_t outside(const vector<pt>& points, const vector<pt>& hull){
+    if( hull.size() < 3 )
+        return 0;
+    double area = 0;
+    for( size_t i = 0; i < hull.size(); ++i ){
+        const pt& a = hull[i];
+        const pt& b = hull[(i+1) % hull.size()];
+        area += a.x*b.y - a.y*b.x;
+    }
+    const int inward = area > 0 ? 1 : -1;
+    size_t count = 0;
+    for( auto& p: points ){
+        for( size_t i = 0; i < hull.size(); ++i ){
+            if( orient2d( hull[i], hull[(i+1) % hull.size()], p ) == -inward ){
+                ++count;
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+template<typename F>
+double milliseconds(F&& f){
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+void randomPoints(){
+    std::mt19937_64 random(1);
+    printf( "%-10s %-12s %10s %10s %10s\n", "points", "", "hull", "outside", "ms" );
+    for( size_t n = 1000; n <= 10000000; n *= 10 ){
+        const vector<pt> points = disk(n, random);
+        const bool check = n <= 100000;
+        auto report = [&](const char* name, const vector<pt>& hull, double ms){
+            if( check )
+                printf( "%-10zu %-12s %10zu %10zu %10.2f\n", n, name, hull.size(), outside(points, hull), ms );
+            else
+                printf( "%-10zu %-12s %10zu %10s %10.2f\n", n, name, hull.size(), "-", ms );
+        };
+
+        vector<pt> hull;
+        double ms = milliseconds([&]{
+            vector<pt> copy{points};
+            hull = grahamScan(copy);
+        });
+        report( "grahamScan", hull, ms );
+        if( n <= 100000 ){
+            ms = milliseconds([&]{
+                vector<pt> copy{points};
+                hull = jarvisMarch(copy);
+            });
+            report( "jarvisMarch", hull, ms );
+        }
+        vector<pt> scratch;
+        ms = milliseconds([&]{ convexHull(points.data(), points.data() + points.size(), scratch, hull); });
+        report( "convexHull", hull, ms );
+    }
+}
+
+void contourPolygons(const Bitmap& image, uint32_t step, int32_t isovalue){
+    const auto cont = findContours(image, isovalue, step, true);
+    vector<const vector<pt>*> polygons;
+    size_t points = 0;
+    for( auto& p: cont ){
+        if( p.size() > 3 ){
+            polygons.push_back(&p);
+            points += p.size();
+        }
+    }
+    printf( "\n%dx%d step %u, %zu polygons, %zu points\n", image.width(), image.height(), step, polygons.size(), points );
+
+    // Small polygons take next to no time, each way is run RUNS times
+    const int RUNS = 20;
+    vector<vector<pt>> hulls;
+    auto report = [&](const char* name, auto&& f){
+        const double ms = milliseconds([&]{
+            for( int r = 0; r < RUNS; ++r ){
+                f();
+            }
+        });
+        printf( "%-24s %10.3f ms\n", name, ms / RUNS );
+    };
+    report( "copy and grahamScan", [&]{
+        auto copy{cont};
+        hulls.clear();
+        for( auto& p: copy ){
+            if( p.size() > 3 )
+                hulls.push_back(grahamScan(p));
+        }
+    });
+    report( "convexHulls serial", [&]{ hulls = convexHulls(polygons, Execution::Serial); } );
+    report( "convexHulls parallel", [&]{ hulls = convexHulls(polygons, Execution::Parallel); } );
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+    const uint32_t step    = argc > 2 ? uint32_t(atoi(argv[2])) : 1;
+    const int32_t isovalue = argc > 3 ? atoi(argv[3]) : ISOVALUE;
+    randomPoints();
+    Bitmap image;
+    loadBitmap(image, argc > 1 ? argv[1] : "test.bmp");
+    contourPolygons(image, step, isovalue);
+    return 0;
+}
@@ -1,14 +1,23 @@
 #include <iostream>
 #include <algorithm>
 #include <numeric>
-#include <valarray>
 #include <iterator>
 #include <string>
 #include <map>
 #include <iomanip>
+#include <fstream>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "point.hpp"
-#include "jarvisMarch.hpp"
+#include "ConvexHull.h"
 #include "bitmap.h"
+#include "PlanarBitmap.h"
+#include "PointOps.h"
+#include "SeparableBlur.hpp"
+#include "Tiling.hpp"
+#include "Contours.h"
 
 /*
  * Friend read stream operator
@@ -17,42 +26,16 @@
 istream& operator>>(istream& in, Bitmap& bitmap) {
     // Always start with a fresh copy
     Bitmap b;
-
-    // We want to read from in and place it in the Bitmap
-    //in.read(b.header.ftype, sizeof(b.header)-2); // See header for explanation
-    in.read(reinterpret_cast<char*>(&b.header), sizeof(b.header));
-    if(string(b.header.ftype).compare("BM") < 0 )
-        throw BadFileTypeException();
-    // Check for first 2 bytes are BM, or else not BMP file
-
-    in.read(reinterpret_cast<char*>(&b.dibs), sizeof(b.dibs));
-    // Bitmap File Header
-
-    // Compression 0 means bitdepth will be 24
-    // Compression 3 means bitdepth will be 32
-
-    // If 24 bit ( cmpsn 0 ) then we don't get colorspace, and comes in predetrmined
-    // order
-    if( b.dibs.cmpsn == 3 ){
-        in.read(reinterpret_cast<char*>(&b.colorspace), sizeof(b.colorspace) );
-        b.setmask( );
-    }else{
-        // Default values for 24 bpp
-        b.r_mask = 2;
-        b.g_mask = 1;
-        b.b_mask = 0;
-    }
+    b.readHeaders(in);
 
     // We have enough information to set aside the memory needed to load the rest
     // of the image
-
-    b._bpp = b.dibs.cDepth>>3;
-    b._rowSize = b.__rowSize( b._bpp, b.dibs.width);
-    b._rowWidth = b.__rowWidth(b.dibs.cDepth, b.dibs.width );
-
     b._bits.resize(b.dibs.rawSize);
 
+    // Pooled memory is not cleared, a short file would leave an older image showing
     in.read(reinterpret_cast<char*>(b._bits.data()), b.dibs.rawSize);
+    if( size_t(in.gcount()) != b.dibs.rawSize )
+        throw TruncatedFileException();
     // If nothings gone wrong, swap it out
     swap(bitmap, move(b));
 
@@ -63,19 +46,98 @@ istream& operator>>(istream& in, Bitmap& bitmap) {
  * Friend write stream operator
  */
 ostream& operator<<(ostream& out, const Bitmap& b) {
-    // Write header
-    //out.write( b.header.ftype, sizeof(b.header)-2); // See header for explanation
-    out.write(reinterpret_cast<const char*>(&b.header), sizeof(b.header));
-    out.write( reinterpret_cast<const char*>(&b.dibs), sizeof(b.dibs));
-    // Colorspace if 32bit which is implied by cmpsn != 0
-    if( b.dibs.cmpsn )
-        out.write( reinterpret_cast<const char*>(&b.colorspace), sizeof(b.colorspace));
+    b.writeHeaders(out);
 
     // Then body
-    out.write( reinterpret_cast<const char*>(b._bits.data()), b._bits.size());
+    out.write( reinterpret_cast<const char*>(b.data()), b.rawSize());
     return out;
 }
 
+/*
+ * Internal use only, reads the headers out of the start of a file, which has size
+ * bytes, and sets up the layout
+ */
+void Bitmap::parseHeaders( const uint8_t* file, size_t size ){
+    if( size < sizeof(header) + sizeof(dibs) )
+        throw TruncatedFileException();
+    memcpy(&header, file, sizeof(header));
+    // Check for first 2 bytes are BM, or else not BMP file
+    if( header.ftype[0] != 'B' || header.ftype[1] != 'M' )
+        throw BadFileTypeException();
+    memcpy(&dibs, file + sizeof(header), sizeof(dibs));
+
+    // Compression 0 means bitdepth will be 24
+    // Compression 3 means bitdepth will be 32
+
+    // If 24 bit ( cmpsn 0 ) then we don't get colorspace, and comes in predetrmined
+    // order
+    if( dibs.cmpsn == 3 ){
+        if( size < sizeof(header) + sizeof(dibs) + sizeof(colorspace) )
+            throw TruncatedFileException();
+        memcpy(&colorspace, file + sizeof(header) + sizeof(dibs), sizeof(colorspace));
+    }
+    initLayout();
+}
+
+/*
+ * Internal use only, reads everything up to the pixels and sets up the layout. Leaves
+ * the stream at the start of the pixel data, wherever header.offset puts it.
+ */
+void Bitmap::readHeaders( istream& in ){
+    const istream::pos_type start = in.tellg();
+    // As much as the headers could take up, a short file is only an error if the
+    // headers it has need more
+    uint8_t file[sizeof(header) + sizeof(dibs) + sizeof(colorspace)];
+    in.read(reinterpret_cast<char*>(file), sizeof(file));
+    const size_t size = size_t(in.gcount());
+    in.clear();
+    parseHeaders(file, size);
+    in.seekg(start + istream::off_type(header.offset));
+}
+
+/*
+ * Internal use only, writes everything up to the pixels
+ */
+void Bitmap::writeHeaders( ostream& out ) const{
+    // Write header
+    //out.write( header.ftype, sizeof(header)-2); // See header for explanation
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write( reinterpret_cast<const char*>(&dibs), sizeof(dibs));
+    // Colorspace if 32bit which is implied by cmpsn != 0
+    if( dibs.cmpsn )
+        out.write( reinterpret_cast<const char*>(&colorspace), sizeof(colorspace));
+}
+
+/*
+ * Maps the file and reads the headers out of the mapping, the pixels are left where
+ * they are. Like the stream operator this builds a fresh copy and swaps at the end.
+ */
+void Bitmap::mapFile( const string& filename ){
+    Bitmap b;
+    b._mapping = make_shared<const MappedFile>(filename);
+    const uint8_t* file = b._mapping->data();
+    const size_t size = b._mapping->size();
+    b.parseHeaders(file, size);
+
+    // Everything past here is read in place
+    if( b.header.offset > size || size - b.header.offset < b.dibs.rawSize )
+        throw TruncatedFileException();
+    b._mapped = file + b.header.offset;
+
+    swap(*this, move(b));
+}
+
+void loadBitmap(Bitmap& b, const string& filename, LoadMode mode){
+    if( mode == LoadMode::Mapped ){
+        b.mapFile(filename);
+    }else{
+        ifstream in(filename, ios::binary);
+        if( !in )
+            throw FileOpenException();
+        in >> b;
+    }
+}
+
 /*
  * Friend swap, uses move semantics on the right
  * To keep most operations exception safe we use a copy and swap a lot but the default
@@ -93,6 +155,8 @@ void swap( Bitmap &lhs, Bitmap &&rhs ){
     lhs._rowWidth    = move(rhs._rowWidth);
     lhs._bpp         = move(rhs._bpp);
     lhs._bits        = move(rhs._bits);
+    lhs._mapping     = move(rhs._mapping);
+    lhs._mapped      = rhs._mapped;
 }
 
 /*
@@ -114,12 +178,59 @@ _bpp{rhs._bpp},
 _bits{}
 {
     if( noData ){
-        _bits.resize(rhs._bits.size()); // Set the size only
+        _bits.resize(rhs.rawSize()); // Set the size only, the pixels are left uninitialized
+        clearPadding();
+    }else if( rhs._mapped ){
+        // Share the mapping, we'll only pay for a copy if this one gets written to
+        _mapping = rhs._mapping;
+        _mapped  = rhs._mapped;
     }else{
         _bits = rhs._bits;
     }
 }
 
+/*
+ * Internal use only, fills in the pixel layout once the headers have been read. The
+ * colorspace is only looked at for 32 bit images.
+ */
+void Bitmap::initLayout(){
+    if( dibs.cmpsn == 3 ){
+        setmask( );
+    }else{
+        // Default values for 24 bpp
+        r_mask = 2;
+        g_mask = 1;
+        b_mask = 0;
+    }
+
+    _bpp = dibs.cDepth>>3;
+    _rowSize = __rowSize( _bpp, dibs.width);
+    _rowWidth = __rowWidth(dibs.cDepth, dibs.width );
+}
+
+/*
+ * Internal use only, zeroes the bytes past the end of each row. Buffers from the pool
+ * come back with whatever was in them and the padding is written out as is.
+ */
+void Bitmap::clearPadding(){
+    const uint32_t padding = _rowWidth - _rowSize;
+    if( !padding )
+        return;
+    for( size_t row = 0; row + _rowWidth <= _bits.size(); row += _rowWidth ){
+        fill_n( _bits.data() + row + _rowSize, padding, 0 );
+    }
+}
+
+/*
+ * Internal use only, first write to a mapped bitmap. Everything else has already been
+ * read from the headers so only the pixels need to come across.
+ */
+void Bitmap::_detach(){
+    _bits.assign(_mapped, _mapped + dibs.rawSize);
+    _mapped = nullptr;
+    _mapping.reset();
+}
+
 /*
 Internal use only, takes the mask order and determines which order the masks are in
 and sets the internel masks for position within a pixel. This is only called in case
@@ -176,6 +287,7 @@ uint32_t Bitmap::maskToInt( uint32_t mask ) noexcept{
  * Does not check bounds!
  */
 inline uint8_t& Bitmap::getPixel( int x, int y, uint32_t mask ){
+    detach();
     return const_cast<uint8_t&>(static_cast<const Bitmap&>(*this).getPixel(x,y,mask));
 }
 
@@ -183,24 +295,32 @@ inline const uint8_t& Bitmap::getPixel(int x, int y, uint32_t mask) const{
     if( x > dibs.width || y > ( dibs.height < 0 ? -dibs.height : dibs.height ) )
         throw OutOfBoundsException();
     if( dibs.height < 0 )
-        y = (-dibs.height) - y;
-    return _bits[ y*_rowWidth + (x*_bpp) + mask ];
+        y = (-dibs.height) - 1 - y;
+    return data()[ y*_rowWidth + (x*_bpp) + mask ];
 }
 /*
- * Takes a value and returns either the low or high depending on whether it is above the threshold or not [0x00,0x54)
+ * Runs f on every row of b, a band of rows per task on the thread pool, f gets a
+ * pointer to the first byte of the row. Only for filters where each pixel depends on
+ * nothing but itself.
  */
-inline uint8_t clip( uint8_t value )noexcept{
-    return (value < 0x40 ? 0x00 : (value < 0xC0 ? 0x80 : 0xFF ) );
+template<typename F>
+inline void forEachRow(Bitmap& b, F&& f){
+    auto rows = b.rows();
+    forEachTile( rowBands(b.width(), b.height()), Execution::Parallel, [&](const Tile& band){
+        for( int32_t y = band.y0; y < band.y1; ++y ){
+            f( rows.begin()[y] );
+        }
+    });
 }
 
 /*
  * Peforms a cell (sic) shade operation over the entire image
  */
-void cellShade(Bitmap& b)noexcept{
-    for_each(b.begin(),b.end(),[&b](auto& value){
-        *(&value+b.rmask()) = clip(*(&value+b.rmask()) );
-        *(&value+b.gmask()) = clip(*(&value+b.gmask()) );
-        *(&value+b.bmask()) = clip(*(&value+b.bmask()) );
+void cellShade(Bitmap& b){
+    const int32_t w = b.width();
+    withFormat(b, [&](auto format){
+        constexpr PointLayout layout = pointLayout<decltype(format)>();
+        forEachRow(b, [&](uint8_t* row){ cellShadeRow(row, w, layout); });
     });
 }
 
@@ -210,120 +330,109 @@ void cellShade(Bitmap& b)noexcept{
  * which give a more realistic grayscale than averaging.
  */
 void grayscale(Bitmap& b ) {
-    int count = 0;
-    for_each(b.begin(),b.end(),[&b,&count](auto& value){
-        ++count;
-        uint8_t y = *(&value+b.rmask())*0.216
-                  + *(&value+b.gmask())*0.7152
-                  + *(&value+b.bmask())*0.0722;
-        *(&value+b.rmask()) = y;
-        *(&value+b.gmask()) = y;
-        *(&value+b.bmask()) = y;
+    const int32_t w = b.width();
+    withFormat(b, [&](auto format){
+        constexpr PointLayout layout = pointLayout<decltype(format)>();
+        forEachRow(b, [&](uint8_t* row){ grayscaleRow(row, w, layout); });
+    });
+}
+
+/*
+ * Applies each step of chain to a row before moving on to the next row
+ */
+void pointChain(Bitmap& b, const PointChain& chain){
+    if( chain.empty() )
+        return;
+    const int32_t w = b.width();
+    withFormat(b, [&](auto format){
+        constexpr PointLayout layout = pointLayout<decltype(format)>();
+        forEachRow(b, [&](uint8_t* row){ chain.apply(row, w, layout); });
     });
 }
 
 /*
  * Performs a gaussian blur operation over entire image
- * Calls a function that could throw, but we always call it with two matrices of the same
- * size which are the conditions that it throws, so meh. We do a copy-swap on the image.
- */
-void blur(Bitmap& b ) {
-    // Slide 35    
-    // This is a more intense piece, we'll need to do an elementwise matrix multiplication
-    // We'll want to work on a copy as we'll need the unaffected section
-    Bitmap gauss(b);
-
-    // We'll load a vector flattened with the gaussian blurr, and then pull from our original image
-    // while pushing to our copy.
-
-    const valarray<uint32_t> matrix= {
-        1,  4,  6,  4, 1,
-        4, 16, 24, 26, 4,
-        6, 24, 36, 24, 6,
-        4, 16, 24, 26, 4,
-        1,  4,  6,  4, 1
-    };
-    // We'll use a uint32_t to store the result, then scale it down.
-    // We'll have 8bit, multiplied by most a 6bit, needing 14bits, then added together with the most 25 times, so another 5 bits, making
-    // a total of 19bits needed. A 32bit int can hold the entire summation, and arguabbly a 16bit int is all we need for the matrix
-    // itself
-    valarray<uint32_t> result[3];
-    for( auto& v: result ){
-        v.resize(matrix.size());
-    }
-    for( int j = 0; j < b.height(); ++j ){
-        for( int i = 0; i < b.width(); ++i ){
-            int xindex = 2;
-            int yindex = -2;
-            // Load the matrix
-            for( uint32_t k = 0; k < matrix.size(); ++k ){
-                // We'll do it a slow way at first, then think about optimization
-                // The biggest roadblock to a good algorithm is optimizing too early
-                result[0][k] = b.r( clamp(i+xindex, 0, b.width()-1 ), clamp(j+yindex, 0, b.height()-1) );
-                result[1][k] = b.g( clamp(i+xindex, 0, b.width()-1 ), clamp(j+yindex, 0, b.height()-1) );
-                result[2][k] = b.b( clamp(i+xindex, 0, b.width()-1 ), clamp(j+yindex, 0, b.height()-1) );
-                // Update indexes
-                if( yindex == 2 ){
-                    --xindex;
-                    yindex = -2;
-                }else{
-                    ++yindex;
+ * The horizontal and vertical passes are done by separableBlur, in place, a band of
+ * rows per thread. Only the colors are written back.
+ */
+void blur(Bitmap& b, int32_t radius, Execution exec) {
+    const int32_t w = b.width();
+    auto rows = b.rows();
+
+    withFormat(b, [&](auto format){
+        typedef decltype(format) F;
+        separableBlur<F::bpp>( w, b.height(), radius, exec,
+            [&rows](int32_t y){ return rows.begin()[y]; },
+            [&rows, w](int32_t y, const uint8_t* blurred){
+                typename F::template Row<uint8_t> row( rows.begin()[y], w );
+                for( int32_t x = 0; x < w; ++x, blurred += F::bpp ){
+                    uint8_t* pixel = row[x];
+                    pixel[F::r] = blurred[F::r];
+                    pixel[F::g] = blurred[F::g];
+                    pixel[F::b] = blurred[F::b];
                 }
-            } // k
-            // hadamard
-
-            for( uint32_t i = 0; i < 3; ++i ){
-                result[i] *= matrix;
-            }
-            // Now stuff it back in
-            gauss.r( i,j ) = clamp( ((result[0].sum()) >> 8 ), 0u, 255u) ;
-            gauss.g( i,j ) = clamp( ((result[1].sum()) >> 8 ), 0u, 255u) ;
-            gauss.b( i,j ) = clamp( ((result[2].sum()) >> 8 ), 0u, 255u) ;
-            // Update indexes
-        } // j
-    } // i
-    swap(b,move(gauss));
+            });
+    });
 }
 
 /*
  * Performs a pixalation operation over entire image
- */ 
-void pixelate(Bitmap& b) {
-    // The idea here is to take a percentage of the width to use as the diameter. If it is less than 100
-    // then we'll take the midpoint. We start at a half radius from the edge and move from there.
-    Bitmap pix(b);
-    valarray<uint32_t> matrix[3];
-    uint32_t result[3] = {0,0,0};
-    for( auto& v: matrix ){
-        v.resize(16*16);
-    }
-    // Use a marching algorithm instead of loops of loops
-
-    for( int j = 0; j < b.height(); j += 16 ){
-        for( int i = 0; i < b.width(); i += 16 ){
-            for( int yindex = 0; yindex < 16 && j + yindex < b.height(); ++yindex ){
-                for( int xindex = 0; xindex < 16 && i + xindex < b.width(); ++xindex ){
-                    matrix[0][(yindex<<4)+xindex] = b.r( i+xindex, j+yindex );
-                    matrix[1][(yindex<<4)+xindex] = b.g( i+xindex, j+yindex );
-                    matrix[2][(yindex<<4)+xindex] = b.b( i+xindex, j+yindex );
-                } // yindex
-            } // xindex
-            // Get the average into result
-            result[0] = matrix[0].size() ? matrix[0].sum()/matrix[0].size() : 0;
-            result[1] = matrix[1].size() ? matrix[1].sum()/matrix[1].size() : 0;
-            result[2] = matrix[2].size() ? matrix[2].sum()/matrix[2].size() : 0;
-            // Now stuff it back in
-            for( int yindex = 0; yindex < 16 && j+yindex < b.height() ; ++yindex ){
-                for( int xindex = 0; xindex < 16 && i+xindex < b.width() ; ++xindex ){
-                    pix.r( i + xindex, j + yindex ) = result[0];
-                    pix.g( i + xindex, j + yindex ) = result[1];
-                    pix.b( i + xindex, j + yindex ) = result[2];
+ * Each block takes the average of the pixels it covers, blocks on the right and bottom
+ * edges are cut short and average only what they cover. A row of blocks is summed one
+ * image row at a time and then filled in, so the work per pixel does not depend on the
+ * block size, and rows of blocks are independent of each other.
+ */
+void pixelate(Bitmap& b, int32_t block, Execution exec) {
+    if( block < 1 )
+        throw InvalidBlockSizeException();
+    const int32_t w = b.width();
+    const int32_t h = b.height();
+    const int32_t blocks = (w + block - 1) / block;
+    auto rows = b.rows();
+
+    withFormat(b, [&](auto format){
+        typedef decltype(format) F;
+        forEachTile( rowBands(w, h, block), exec, [&](const Tile& band){
+            const int32_t j = band.y0;
+            const int32_t last = band.y1;
+            // Red, green and blue sums of each block in the row
+            vector<uint64_t> sums( 3*blocks, 0 );
+            for( int32_t y = j; y < last; ++y ){
+                typename F::template Row<const uint8_t> row( rows.begin()[y], w );
+                for( int32_t i = 0, x = 0; i < blocks; ++i ){
+                    uint32_t r = 0, g = 0, bl = 0;
+                    for( const int32_t end = min( x + block, w ); x < end; ++x ){
+                        const uint8_t* pixel = row[x];
+                        r  += pixel[F::r];
+                        g  += pixel[F::g];
+                        bl += pixel[F::b];
+                    }
+                    sums[3*i]   += r;
+                    sums[3*i+1] += g;
+                    sums[3*i+2] += bl;
                 }
             }
-
-        } // j
-    } // i
-    swap(b,move(pix));
+            vector<uint8_t> average( 3*blocks );
+            for( int32_t i = 0; i < blocks; ++i ){
+                const uint64_t count = uint64_t( min( block, w - i*block ) ) * ( last - j );
+                for( int32_t c = 0; c < 3; ++c ){
+                    average[3*i+c] = uint8_t( sums[3*i+c] / count );
+                }
+            }
+            for( int32_t y = j; y < last; ++y ){
+                typename F::template Row<uint8_t> row( rows.begin()[y], w );
+                for( int32_t i = 0, x = 0; i < blocks; ++i ){
+                    const uint8_t* color = &average[3*i];
+                    for( const int32_t end = min( x + block, w ); x < end; ++x ){
+                        uint8_t* pixel = row[x];
+                        pixel[F::r] = color[0];
+                        pixel[F::g] = color[1];
+                        pixel[F::b] = color[2];
+                    }
+                }
+            }
+        });
+    });
 }
 
 /*
@@ -354,7 +463,10 @@ void Bitmap::setDimension( int32_t width, int32_t height ){
     // Calculate new size
     _d.rawSize = __rawSize(_d.height, rowWidth);
 
-    // Reset internal rpresentation
+    // Reset internal rpresentation, callers such as fliph rely on the pixels surviving
+    // when the size does not change
+    detach();
+    const bool relayout = _bits.size() != _d.rawSize || rowWidth != _rowWidth;
     if( _bits.size() != _d.rawSize )
         _bits.resize( _d.rawSize );
 
@@ -364,75 +476,168 @@ void Bitmap::setDimension( int32_t width, int32_t height ){
     this->_rowWidth  = rowWidth;
     this->header.size = _d.rawSize + header.offset;
 
+    if( relayout )
+        clearPadding();
+
 }
 
 /*
- * Rotates the image clockwise 90*
+ * Internal use only, same as setDimension but only the headers are changed. Used to
+ * describe images that are never held in memory all at once.
  */
-void rot90(Bitmap& o) {
-    Bitmap b(o, true);
-    b.setDimension( o.height(), o.width() );
+void Bitmap::setHeaderDimension( int32_t width, int32_t height ){
+    if( width <= 0 )
+        throw InvalidWidthException();
+    dibs.width   = width;
+    dibs.height  = height;
+    _rowWidth    = __rowWidth(dibs.cDepth, width);
+    _rowSize     = __rowSize(_bpp, width);
+    dibs.rawSize = __rawSize(height, _rowWidth);
+    header.size  = dibs.rawSize + header.offset;
+}
 
-    // Iterate through
-    for( int j = 0; j < b.height(); ++j ){
-        int x = b.height() - 1 - j;
-        for( int i = 0; i < b.width(); ++i ){
-            int y = i;
-            b.r( i, j ) = o.r( x, y );
-            b.g( i, j ) = o.g( x, y );
-            b.b( i, j ) = o.b( x, y );
-            if( o.hasAlpha() ){
-                b.a( i, j ) = o.a( x, y );
+/*
+ * Copies one whole pixel, alpha and all
+ */
+template<uint32_t BPP>
+inline void copyPixel( const uint8_t* from, uint8_t* to ){
+    copy_n( from, BPP, to );
+}
+
+// Side of the square blocks the transposing filters copy at a time, in pixels
+const int32_t TRANSPOSETILE = 64;
+
+#ifdef __SSE2__
+/*
+ * Transposes a 4x4 block of 32 bit pixels. from holds four source rows starting at
+ * column x, the block lands in four destination rows starting at column i, bottom up
+ * when FLIPX.
+ */
+template<bool FLIPX>
+inline void transpose4x4( const uint8_t* const* from, int32_t x, uint8_t* const* to, int32_t i ){
+    const __m128i r0 = _mm_loadu_si128( reinterpret_cast<const __m128i*>(from[0] + x*4) );
+    const __m128i r1 = _mm_loadu_si128( reinterpret_cast<const __m128i*>(from[1] + x*4) );
+    const __m128i r2 = _mm_loadu_si128( reinterpret_cast<const __m128i*>(from[2] + x*4) );
+    const __m128i r3 = _mm_loadu_si128( reinterpret_cast<const __m128i*>(from[3] + x*4) );
+    const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+    const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+    const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+    const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+    const __m128i c[4] = { _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+                           _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3) };
+    for( int k = 0; k < 4; ++k ){
+        _mm_storeu_si128( reinterpret_cast<__m128i*>(to[FLIPX ? 3-k : k] + i*4), c[k] );
+    }
+}
+#endif
+
+/*
+ * Shared body of rot90, rot270, flipd1 and flipd2. dst is src turned on its side:
+ * pixel (i,j) of dst is src(j,i), mirrored in x when FLIPX and in y when FLIPY.
+ * Fills one tile of dst, at most TRANSPOSETILE square, so the source rows being read
+ * stay in cache, 32 bit pixels go four by four through SSE where available.
+ */
+template<uint32_t BPP, bool FLIPX, bool FLIPY>
+void transposeTile( const Bitmap& src, Bitmap& dst, const Tile& tile ){
+    const int32_t sw = src.width();
+    const int32_t sh = src.height();
+    const int32_t j0 = tile.y0, j1 = tile.y1;
+    const int32_t i0 = tile.x0, i1 = tile.x1;
+    const uint8_t* from[TRANSPOSETILE];
+    uint8_t* to[TRANSPOSETILE];
+
+    for( int32_t j = j0; j < j1; ++j ){
+        to[j-j0] = dst.row<BPP>(j).data();
+    }
+    for( int32_t i = i0; i < i1; ++i ){
+        from[i-i0] = src.row<BPP>( FLIPY ? sh - 1 - i : i ).data();
+    }
+
+    int32_t j = j0;
+#ifdef __SSE2__
+    if constexpr( BPP == 4 ){
+        for( ; j + 4 <= j1; j += 4 ){
+            const int32_t x = FLIPX ? sw - 4 - j : j;
+            int32_t i = i0;
+            for( ; i + 4 <= i1; i += 4 ){
+                transpose4x4<FLIPX>( from + (i-i0), x, to + (j-j0), i );
+            }
+            for( ; i < i1; ++i ){
+                for( int32_t k = 0; k < 4; ++k ){
+                    const int32_t xk = FLIPX ? sw - 1 - (j+k) : j + k;
+                    copyPixel<BPP>( from[i-i0] + xk*BPP, to[j+k-j0] + i*BPP );
+                }
             }
         }
     }
+#endif
+    for( ; j < j1; ++j ){
+        const int32_t x = FLIPX ? sw - 1 - j : j;
+        uint8_t* row = to[j-j0];
+        for( int32_t i = i0; i < i1; ++i ){
+            copyPixel<BPP>( from[i-i0] + x*BPP, row + i*BPP );
+        }
+    }
+}
+
+/*
+ * Runs transposeTile over the whole of dst, one TRANSPOSETILE square per task
+ */
+template<bool FLIPX, bool FLIPY>
+void transpose( Bitmap& o, Execution exec ){
+    Bitmap b(o, true);
+    b.setDimension( o.height(), o.width() );
+    const Bitmap& src = o;
+
+    withDepth(o.bpp(), [&](auto depth){
+        constexpr uint32_t BPP = decltype(depth)::value;
+        forEachTile( tiles(b.width(), b.height(), TRANSPOSETILE, TRANSPOSETILE), exec, [&](const Tile& tile){
+            transposeTile<BPP, FLIPX, FLIPY>( src, b, tile );
+        });
+    });
     swap(o,move(b));
 }
 
+/*
+ * Rotates the image clockwise 90*
+ */
+void rot90(Bitmap& o, Execution exec) {
+    // Row j of the result is column width-1-j of the original
+    transpose<true, false>(o, exec);
+}
+
 /*
  * Rotates the image both clockwise and counterclockwise 180* :-)
  */
 void rot180(Bitmap& o ) {
     // Similar idea, We'll just read through the file rewriting it, but no change in dimension.
     Bitmap b(o, true);
+    const Bitmap& src = o;
 
     // Iterate through
-    for( int j = 0; j < b.height(); ++j ){
-        int y = b.height() - 1 - j;
-        for( int i = 0; i < b.width(); ++i ){
-            int x = b.width() - 1 - i;
-            b.r( i, j ) = o.r( x, y );
-            b.g( i, j ) = o.g( x, y );
-            b.b( i, j ) = o.b( x, y );
-            if( o.hasAlpha() ){
-                b.a( i, j ) = o.a( x, y );
+    withDepth(o.bpp(), [&](auto depth){
+        constexpr uint32_t BPP = decltype(depth)::value;
+        forEachTile( rowBands(b.width(), b.height()), Execution::Parallel, [&](const Tile& band){
+            for( int j = band.y0; j < band.y1; ++j ){
+                int y = b.height() - 1 - j;
+                auto from = src.row<BPP>(y);
+                auto row = b.row<BPP>(j);
+                for( int i = 0; i < b.width(); ++i ){
+                    int x = b.width() - 1 - i;
+                    copyPixel<BPP>( from[x], row[i] );
+                }
             }
-        }
-    }
+        });
+    });
     swap(o, move(b));
 }
 
 /*
  * Rotates the image clockwise 270*
  */
-void rot270(Bitmap& o ) {
-    Bitmap b(o, true);
-    b.setDimension( o.height(), o.width() );
-
-    // Iterate through
-    for( int j = 0; j < b.height(); ++j ){
-        int x = j;
-        for( int i = 0; i < b.width(); ++i ){
-            int y = b.width() -1 -i;
-            b.r( i, j ) = o.r( x, y );
-            b.g( i, j ) = o.g( x, y );
-            b.b( i, j ) = o.b( x, y );
-            if( o.hasAlpha() ){
-                b.a( i, j ) = o.a( x, y );
-            }
-        }
-    }
-    swap(o,move(b));
+void rot270(Bitmap& o, Execution exec) {
+    // Row j of the result is column j of the original read from the top down
+    transpose<false, true>(o, exec);
 }
 
 /*
@@ -442,24 +647,21 @@ void flipv(Bitmap& b ) {
     // cannot have negative width
     // b.setWidth( b.width() * -1 );
     Bitmap pix(b, true);
-    for( int32_t j = 0; j < b.height() ; ++j ){
-        for( int32_t i = 0; i < b.width() >> 1; ++i ){
-            int32_t i2 = b.width() - 1 - i;
-            // Now swap
-            // Could consider swapping by pixel instead of color, perhaps an auto pointer for type deduction
-            // would allow this easily.
-            pix.r( i, j ) = b.r( i2, j );
-            pix.g( i, j ) = b.g( i2, j );
-            pix.b( i, j ) = b.b( i2, j );
-            pix.r( i2, j ) = b.r( i, j );
-            pix.g( i2, j ) = b.g( i, j );
-            pix.b( i2, j ) = b.b( i, j );
-            if( b.hasAlpha() ){
-                pix.a( i, j ) = b.a( i2, j );
-                pix.a( i2, j ) = b.a( i, j );
-            }
-        } // j
-    } // i
+    const Bitmap& src = b;
+    withDepth(b.bpp(), [&](auto depth){
+        constexpr uint32_t BPP = decltype(depth)::value;
+        forEachTile( rowBands(b.width(), b.height()), Execution::Parallel, [&](const Tile& band){
+            for( int32_t j = band.y0; j < band.y1 ; ++j ){
+                auto from = src.row<BPP>(j);
+                auto row = pix.row<BPP>(j);
+                // Whole pixels at a time, includes the middle column of an odd width
+                for( int32_t i = 0; i < b.width(); ++i ){
+                    int32_t i2 = b.width() - 1 - i;
+                    copyPixel<BPP>( from[i2], row[i] );
+                } // i
+            } // j
+        });
+    });
     swap(b, move(pix));
 }
 
@@ -474,47 +676,17 @@ void fliph(Bitmap& b ) noexcept{
 /*
  * Flips over the first diagonal \
  */
-void flipd1(Bitmap& o ) {
+void flipd1(Bitmap& o, Execution exec) {
     // A little bit of group theory should go a long ways. This should be essentially a transpose
-    Bitmap b(o, true);
-    b.setDimension( o.height(), o.width() );
-
-    // Iterate through
-    for( int j = 0; j < b.height(); ++j ){
-        for( int i = 0; i < b.width(); ++i ){
-            b.r( i, j ) = o.r( j, i );
-            b.g( i, j ) = o.g( j, i );
-            b.b( i, j ) = o.b( j, i );
-            if( o.hasAlpha() ){
-                b.a( i, j ) = o.a( j, i );
-            }
-        }
-    }
-    swap(o,move(b));
+    transpose<false, false>(o, exec);
 }
 
 /*
  * Flips over the second diagonal /
  */
-void flipd2(Bitmap& o ) {
-    // A little bit of group theory should go a long ways. This should be essentially a transpose
-    Bitmap b(o, true);
-    b.setDimension( o.height(), o.width() );
-
-    // Iterate through
-    for( int j = 0; j < b.height(); ++j ){
-        int x = o.width() - 1 - j;
-        for( int i = 0; i < b.width(); ++i ){
-            int y = o.height() - 1 - i;
-            b.r( i, j ) = o.r( x, y );
-            b.g( i, j ) = o.g( x, y );
-            b.b( i, j ) = o.b( x, y );
-            if( o.hasAlpha() ){
-                b.a( i, j ) = o.a( x, y );
-            }
-        }
-    }
-    swap(o,move(b));
+void flipd2(Bitmap& o, Execution exec) {
+    // The transpose of rot180
+    transpose<true, true>(o, exec);
 }
 
 /*
@@ -524,47 +696,35 @@ void scaleUp(Bitmap& o ) {
     Bitmap b(o, true);
 
     b.setDimension( b.width() << 1, b.height() << 1 );
-
-    //
-    for( int j = 0; j < o.height(); ++j ){
-        int y = j << 1;
-        for( int i = 0; i < o.width(); ++i ){
-            // Shift the bits since we are doubling
-            // Blocking operations together
-            int x = i << 1;
-
-            uint8_t pixel = o.r( i, j );
-            b.r( x, y ) = pixel;
-            b.r( x + 1, y ) = pixel;
-            b.r( x, y+1 ) = pixel;
-            b.r( x + 1, y+1 ) = pixel;
-            
-            pixel = o.g( i, j );
-            b.g( x, y ) = pixel;
-            b.g( x + 1, y ) = pixel;
-            b.g( x, y+1 ) = pixel;
-            b.g( x + 1, y+1 ) = pixel;
-
-            pixel = o.b( i, j );
-            b.b( x, y ) = pixel;
-            b.b( x + 1, y ) = pixel;
-            b.b( x, y+1 ) = pixel;
-            b.b( x + 1, y+1 ) = pixel;
-
-            if( o.hasAlpha() ){
-                pixel = o.a( i, j );
-                b.a( x, y ) = pixel;
-                b.a( x + 1, y ) = pixel;
-                b.a( x, y+1 ) = pixel;
-                b.a( x + 1, y+1 ) = pixel;
+    const Bitmap& src = o;
+
+    // Bands of source rows, each fills twice as many rows of the result
+    withDepth(o.bpp(), [&](auto depth){
+        constexpr uint32_t BPP = decltype(depth)::value;
+        forEachTile( rowBands(o.width(), o.height()), Execution::Parallel, [&](const Tile& band){
+            for( int j = band.y0; j < band.y1; ++j ){
+                // Shift the bits since we are doubling
+                // Blocking operations together
+                int y = j << 1;
+                auto from = src.row<BPP>(j);
+                auto top = b.row<BPP>(y);
+                auto bottom = b.row<BPP>(y+1);
+                for( int i = 0; i < o.width(); ++i ){
+                    int x = i << 1;
+                    const uint8_t* pixel = from[i];
+                    copyPixel<BPP>( pixel, top[x] );
+                    copyPixel<BPP>( pixel, top[x+1] );
+                    copyPixel<BPP>( pixel, bottom[x] );
+                    copyPixel<BPP>( pixel, bottom[x+1] );
+                }
             }
-        }
-    }
+        });
+    });
     swap(o, move(b));
 }
 template<int GROUP, typename IN, typename OUT>
-void copy_every_n_in_groups_of_m(IN it, IN id, OUT ot, size_t n ){
-    for(; it != id; it+=(n*GROUP)){
+void copy_every_n_in_groups_of_m(IN it, size_t count, OUT ot, size_t n ){
+    for(; count; --count, it+=(n*GROUP)){
         for(auto i=0; i< GROUP; ++i){
             *ot = *(it+i);
             ++ot;
@@ -579,45 +739,95 @@ void scaleDown(Bitmap& o ) {
 
     b.setDimension( b.width() >> 1, b.height() >> 1 );
 
-    vector<decltype (b.getBits().begin())> its;
-    for(int j =0; j < o.height(); j+=2 ){
-        its.push_back(o.getBits().begin()+(j*o.rowWidth()));
-    }
-    auto ot = b.getBits().begin();
-    for(auto& it: its){
-        if(o.bpp() == 4){
-            copy_every_n_in_groups_of_m<4> (it,it+(o.rowWidth()),ot,2);
-        }else{
-            copy_every_n_in_groups_of_m<3> (it,it+(o.rowWidth()),ot,2);
+    // Only ever read from the original, rows are taken in the order they are stored
+    const uint8_t* in = o.data();
+    auto out = b.getBits().begin();
+    forEachTile( rowBands(b.width(), b.height()), Execution::Parallel, [&](const Tile& band){
+        for( int j = band.y0; j < band.y1; ++j ){
+            const uint8_t* it = in + size_t(2*j)*o.rowWidth();
+            auto ot = out + size_t(j)*b.rowWidth();
+            // Stop at the last whole pixel, the padding is left alone
+            if(o.bpp() == 4){
+                copy_every_n_in_groups_of_m<4> (it,b.width(),ot,2);
+            }else{
+                copy_every_n_in_groups_of_m<3> (it,b.width(),ot,2);
+            }
         }
-        ot+=b.rowWidth();
-    }
+    });
     swap( o, move(b) );
 }
 
+/*
+ * Shrinks the image by factor both ways, each pixel of to the average of the
+ * factor x factor block of from it stands for, every byte of the pixel averaged on its
+ * own. Blocks on the right and bottom edges are cut short and average only what they
+ * cover, as in pixelate().
+ */
+void boxShrink(const Bitmap& from, Bitmap& to, int32_t factor, Execution exec){
+    if( factor < 1 )
+        throw InvalidBlockSizeException();
+    const int32_t w  = from.width();
+    const int32_t h  = from.height();
+    const int32_t sw = (w + factor - 1) / factor;
+    const int32_t sh = (h + factor - 1) / factor;
+    to = Bitmap(from, true);
+    to.setDimension( sw, sh );
+
+    withDepth(from.bpp(), [&](auto depth){
+        constexpr uint32_t BPP = decltype(depth)::value;
+        forEachTile( rowBands(sw, sh), exec, [&](const Tile& band){
+            vector<uint32_t> sums( size_t(sw)*BPP );
+            for( int32_t j = band.y0; j < band.y1; ++j ){
+                fill( sums.begin(), sums.end(), 0 );
+                const int32_t y0 = j*factor;
+                const int32_t y1 = min( y0 + factor, h );
+                for( int32_t y = y0; y < y1; ++y ){
+                    auto row = from.row<BPP>(y);
+                    for( int32_t i = 0, x = 0; i < sw; ++i ){
+                        uint32_t* sum = &sums[size_t(i)*BPP];
+                        for( const int32_t end = min( x + factor, w ); x < end; ++x ){
+                            const uint8_t* pixel = row[x];
+                            for( uint32_t c = 0; c < BPP; ++c ){
+                                sum[c] += pixel[c];
+                            }
+                        }
+                    }
+                }
+                auto out = to.row<BPP>(j);
+                for( int32_t i = 0; i < sw; ++i ){
+                    const uint32_t count = uint32_t( min( factor, w - i*factor ) ) * ( y1 - y0 );
+                    uint8_t* pixel = out[i];
+                    for( uint32_t c = 0; c < BPP; ++c ){
+                        pixel[c] = uint8_t( sums[size_t(i)*BPP + c] / count );
+                    }
+                }
+            }
+        });
+    });
+}
+
+void boxShrink(Bitmap& b, int32_t factor, Execution exec){
+    Bitmap shrunk;
+    boxShrink(b, shrunk, factor, exec);
+    swap( b, move(shrunk) );
+}
+
 // Here's what drives our function
 void contours(Bitmap&o, int32_t isovalues, int32_t stepsize, bool useBinaryBitmap){
-    Bitmap b(o);
-    auto cont = findContours(b,isovalues, stepsize, useBinaryBitmap);
-
-    auto process_cont{cont};
-//    vector<vector<pt>> jm;
-//    for( auto& i: process_cont){
-//        jm.push_back(jarvisMarch(i));
-//    }
-//    for( auto& i: jm){
-//        for(auto& j: i){
-//            draw( o, j.x, j.y, 0x00FF00, 8);
-//        }
-//    }
-
-      process_cont = cont;
-      vector<vector<pt>> hulls;
-      for( auto& i: process_cont ){
-          if(i.size() > 3 )
-            hulls.push_back(grahamScan(i));
-      }
-      
+    auto cont = findContours(o,isovalues, stepsize, useBinaryBitmap);
+    drawContours(o, cont, contourHulls(cont));
+}
+
+vector<vector<pt>> contourHulls(const vector<vector<pt>>& cont){
+    vector<const vector<pt>*> polygons;
+    for( auto& i: cont ){
+        if( i.size() > 3 )
+            polygons.push_back(&i);
+    }
+    return convexHulls(polygons);
+}
+
+void drawContours(Bitmap&o, const vector<vector<pt>>& cont, const vector<vector<pt>>& hulls){
       for( auto& i: hulls){
           for(auto& j: i){
               draw( o, j.x, j.y, 0xFF00FF, o.width()/1000 + 8);
@@ -626,7 +836,7 @@ void contours(Bitmap&o, int32_t isovalues, int32_t stepsize, bool useBinaryBitma
       
       //bao trying
       for(auto & hull:hulls){
-          if( hull.empty() ) // happens when polygon is colinier
+          if( hull.empty() )
           {
               continue;
           }
@@ -648,201 +858,140 @@ void contours(Bitmap&o, int32_t isovalues, int32_t stepsize, bool useBinaryBitma
     //cout << "Count: " << count << endl;
 }
 
-vector<vector<pt > > findContours(const Bitmap& o, int32_t isovalue, uint32_t step, bool useBinaryInterp)
+/*
+ * Grayscale as in grayscale(), thresholded the same way as binaryGray()
+ */
+inline uint8_t aboveIsovalue( uint8_t r, uint8_t g, uint8_t b, int32_t isovalue ){
+    return luminance( r, g, b ) > isovalue;
+}
+
+vector<vector<pt > > findContours(const Bitmap& o, int32_t isovalue, uint32_t step, bool useBinaryInterp, Execution exec)
 {
-    Bitmap b(o);
-    binaryGray(b, isovalue);
-
-    const Bitmap &interBitmap = useBinaryInterp ? b : o;
-   // Make it a binary by using a threshold and transforming the entire thing
-
-    // The grids are independent of other grids
-    transform( b.getBits().begin(), b.getBits().end(), b.getBits().begin(),
-        [](auto value){ return (value == 255) ? 1: 0; } );
-
-    // For now, our map of points
-    map<pt,pair<edge,edge>,PointEquality<point_t>> points;
-
-    // Some information for moving iterators
-    // ensure against negative height
-    const uint32_t h = static_cast<uint32_t>(b.height()*(b.height() < 0 ? -1:1));
-    const uint32_t w = static_cast<uint32_t>(b.width());
-    const uint32_t bpp = b.bpp();
-    const uint32_t steps = bpp*step;
-
-    // The four corners march fourth on their horses towards the apocalypse
-
-    auto rb = b.getBits().begin()+b.rmask()+steps;
-    auto rt = rb+w*steps + b.padding()*step;
-
-    // Got it all into one statement without conditionals :-D
-    uint32_t leap = bpp*(w*(step-1)+w%step + !(w%step)*step)+b.padding()*(step);
-
-    for( uint32_t j = 0; j < h-step; j+=step )
-    {
-        // Set the bits in 2 and 3 as the next step will move them to the correct 1 and 4 position
-        uint8_t ot = *(rt-steps) << 2 | *(rb-steps) << 1;
-
-        for( uint32_t i = 0; i < w-step; i+=step )
-        {
-            // Bitwise map pos 2,3 to 1,4
-            ot = composeBits(ot, *rb, *rt);
-            if(ot != 0 && ot != 15){
-                // Use *ot to add to pt
-                auto vs = edges(ot); // our v's
-                auto v = vs.front();
-                if( vs.size() > 1 ){
-                    // Do something with these because of ambiguous case
-                    // Or just ignore it and be consistent in always choosing the first.
-                    // Form Isosurfaces (by Rephael Wenger)
-                    /*
-                     * While the choice of isocontours for the ambiguous configurations change the
-                     * isocontour topology, any of the choices will produce isocntours that are
-                     * 1-manifolds and strictly separate strictly positive vertices from  negative
-                     * vertices.
-                     */
+    // Make it a binary by using a threshold, one byte per pixel with nothing in between
+    const uint32_t w = o.width();
+    const uint32_t h = o.height();
+    PixelBuffer field(size_t(w)*h);
+
+    auto rows = o.rows();
+    withFormat(o, [&](auto format){
+        typedef decltype(format) F;
+        constexpr uint32_t BPP = F::bpp;
+        forEachTile( rowBands(w, h), exec, [&](const Tile& band){
+            for( int32_t y = band.y0; y < band.y1; ++y ){
+                auto row = o.row<BPP>(y);
+                uint8_t* out = field.data() + size_t(y)*w;
+                for( uint32_t x = 0; x < w; ++x ){
+                    const uint8_t* pixel = row[x];
+                    out[x] = aboveIsovalue( pixel[F::r], pixel[F::g], pixel[F::b], isovalue );
                 }
-                // map edges into square space from unit square space
-                // v.first == v, v.second == v'
-                // Points is a map from i,j -> edge pairs
-
-                // in here we want to add our edges to S (the set of all edges)
-                // We'll do (e1+(i,j)),(e2+(i,j)) as our edge pairs
-                // make_edge gurantees vertexs are ordered
-                points.insert(make_pair(pt(i,j),make_pair(
-                                     make_edge<point_t>(
-                                           pt(i,j)+(v.first.first)*step,
-                                           pt(i,j)+(v.first.second)*step
-                                          ),
-                                     make_edge<point_t>(
-                                            pt(i,j)+(v.second.first)*step,
-                                            pt(i,j)+(v.second.second)*step
-                                           )
-                                     ))
-                                 );
             }
-            rt+=steps;
-            rb+=steps;
-        }
-        rt+=leap;
-        rb+=leap;
-        // If there is padding then we'll need to jump forward here
-        // lt+=padding; rt+=padding; lb+=padding; rb+=padding;
-    }
-    // Now that we have our composed vector we can construct our single set of points to
-    // complete the first step
-
-    // Idea here, go through each edge pair finding the one that connects, trace out the
-    // shape and remove these items from the vector and restart the process
-
-    // Interpolation, should be a fun use of transform :-D
-    // And then it wasn't, for ftw
+        });
+    });
 
-    map<pt,pair<pt,pt>,PointEquality<point_t>> interpolated_points;
+    if( useBinaryInterp ){
+        // The field itself, crossings land on the corner below the isovalue
+        return marchingSquares(field.data(), w, h, w, step, ContourSamples{ field.data(), ptrdiff_t(w), 1 }, exec);
+    }
+    // Red channel, straight out of the rows
+    const ptrdiff_t stride = h > 1 ? rows.begin()[1] - rows.begin()[0] : 0;
+    return marchingSquares(field.data(), w, h, w, step, ContourSamples{ rows.begin()[0] + o.rmask(), stride, o.bpp() }, exec);
+}
 
-    for(auto i: points){
-        pt e1 = interpolation(i.second.first.first, i.second.first.second, interBitmap.r(i.second.first.first), interBitmap.r(i.second.first.second), 0 );
-        pt e2 = interpolation(i.second.second.first, i.second.second.second, interBitmap.r(i.second.second.first), interBitmap.r(i.second.second.second), 0 );
+vector<vector<pt > > findContours(const PlanarBitmap& o, int32_t isovalue, uint32_t step, bool useBinaryInterp, Execution exec)
+{
+    const uint32_t w = o.width();
+    const uint32_t h = o.height();
+    PixelBuffer field(size_t(w)*h);
+
+    forEachTile( rowBands(w, h), exec, [&](const Tile& band){
+        for( int32_t y = band.y0; y < band.y1; ++y ){
+            const uint8_t* r = o.row(o.rmask(), y);
+            const uint8_t* g = o.row(o.gmask(), y);
+            const uint8_t* b = o.row(o.bmask(), y);
+            uint8_t* out = field.data() + size_t(y)*w;
+            for( uint32_t x = 0; x < w; ++x ){
+                out[x] = aboveIsovalue( r[x], g[x], b[x], isovalue );
+            }
+        }
+    });
 
-        interpolated_points[i.first] = make_pair( e1, e2 );
+    if( useBinaryInterp ){
+        return marchingSquares(field.data(), w, h, w, step, ContourSamples{ field.data(), ptrdiff_t(w), 1 }, exec);
     }
+    return marchingSquares(field.data(), w, h, w, step, ContourSamples{ o.row(o.rmask(), 0), ptrdiff_t(o.stride()), 1 }, exec);
+}
 
-    vector<vector<pt>> polygons;
-    while(!interpolated_points.empty())
-    {
-        vector<pt> poly = {};
-
-        // Put the point into our polygon
-        // 1. Find a point that shares the first edge
-        // 2. Place point in bag, remove shared edge, check for next edge
-        // 3. ...
-        // 4. Profit!!
-        // 5. If next edge == current.second, then stop
-
-        // Prime the pump
-        // Get the first element by iterator since this is a map
-        // For a map it->first == key, it->second == value
-        auto it = interpolated_points.begin();
-        pt first_pt = it->first;
-        poly.emplace_back(first_pt);
-        pt last_edge = it->second.second;
-        pt current_edge = it->second.first;
-        pt cv = first_pt;
-
-        // Remove point
-        interpolated_points.erase(it);
-
-        // Then find the next
-        bool done = false;
-        while( !done ){
-            vector<pair<pt,pair<pt,pt>>> found;
-            for_each( interpolated_points.begin(), interpolated_points.end(),
-                      [&current_edge,&found](auto value){
-                // Check both edges
-                if (value.second.first == current_edge || value.second.second == current_edge){
-                    found.emplace_back(value);
-                }
-            } );
-            if( found.empty()){
-                // No points
-                //cout << "Broken Segment, Starting new Polygon" << endl;
-                break;
-            }
-            auto best_pt = found.back(); found.pop_back();
-
-            // Find the closest point if there is ambiquity
-            // We might need to instead track the previous point and
-            // Find which direction we came from to know where to go.
-            for( auto i: found ){
-                if( distance( cv, i.first) < distance( cv, best_pt.first)){
-                    best_pt = i;
+vector<vector<vector<pt>>> findContours(const Bitmap& o, const vector<int32_t>& isovalues, uint32_t step,
+                                        bool useBinaryInterp, Execution exec)
+{
+    // Luminance once for every level
+    const uint32_t w = o.width();
+    const uint32_t h = o.height();
+    PixelBuffer gray(size_t(w)*h);
+
+    auto rows = o.rows();
+    withFormat(o, [&](auto format){
+        typedef decltype(format) F;
+        constexpr uint32_t BPP = F::bpp;
+        forEachTile( rowBands(w, h), exec, [&](const Tile& band){
+            for( int32_t y = band.y0; y < band.y1; ++y ){
+                auto row = o.row<BPP>(y);
+                uint8_t* out = gray.data() + size_t(y)*w;
+                for( uint32_t x = 0; x < w; ++x ){
+                    const uint8_t* pixel = row[x];
+                    out[x] = luminance( pixel[F::r], pixel[F::g], pixel[F::b] );
                 }
             }
+        });
+    });
 
-            // Update the current vertex
-            cv = best_pt.first;
-
-            if( current_edge == best_pt.second.first){
-                poly.emplace_back(best_pt.second.first);
-                current_edge = best_pt.second.second;
-            }else{
-                poly.emplace_back(best_pt.second.second);
-                current_edge = best_pt.second.first;
-            }
-            interpolated_points.erase(best_pt.first);
+    const ptrdiff_t stride = h > 1 ? rows.begin()[1] - rows.begin()[0] : 0;
+    return marchingSquaresLevels(gray.data(), w, h, w, step, isovalues, useBinaryInterp,
+                                 ContourSamples{ rows.begin()[0] + o.rmask(), stride, o.bpp() }, exec);
+}
 
-            if( current_edge == last_edge ){
-                //cout << "Finished Building Polygon" << endl;
-                done = true;
+vector<vector<vector<pt>>> findContours(const PlanarBitmap& o, const vector<int32_t>& isovalues, uint32_t step,
+                                        bool useBinaryInterp, Execution exec)
+{
+    const uint32_t w = o.width();
+    const uint32_t h = o.height();
+    PixelBuffer gray(size_t(w)*h);
+
+    forEachTile( rowBands(w, h), exec, [&](const Tile& band){
+        for( int32_t y = band.y0; y < band.y1; ++y ){
+            const uint8_t* r = o.row(o.rmask(), y);
+            const uint8_t* g = o.row(o.gmask(), y);
+            const uint8_t* b = o.row(o.bmask(), y);
+            uint8_t* out = gray.data() + size_t(y)*w;
+            for( uint32_t x = 0; x < w; ++x ){
+                out[x] = luminance( r[x], g[x], b[x] );
             }
         }
-        polygons.emplace_back(poly);
-    }
-
-    return polygons;
-}
+    });
 
-inline uint8_t composeBits(uint8_t b, uint8_t b2, uint8_t b3 ){
-    // This maps 2,3 to 1,4, then sets 2, 3 to new bits
-    // This allows us to march forward with only two iterators
-    return ( (b << 1 | b >> 1) & 0b1001 ) | b2 << 1 | b3 << 2;
-}
-// sp != sq or else arithmetic error, divide by zero
-inline pt interpolation( pt p, pt q, point_t sp, point_t sq, point_t sigma){
-    double alpha = (sigma - sp)/(sq - sp);
-    return pt( (1-alpha)*p.x + alpha*q.x, (1-alpha)*p.y + alpha*q.y );
+    return marchingSquaresLevels(gray.data(), w, h, w, step, isovalues, useBinaryInterp,
+                                 ContourSamples{ o.row(o.rmask(), 0), ptrdiff_t(o.stride()), 1 }, exec);
 }
 
 void draw(Bitmap&o, uint32_t x, uint32_t y, uint32_t color, uint32_t thickness ){
     // Need a good way to pull out the color, or split this, but for now we'll
     // Leave this like this
-    for( uint32_t i = 0; i < thickness && x+i < o.width(); ++i){
+    const uint8_t red   = (color & 0xFF0000) >> 16;
+    const uint8_t green = (color & 0x00FF00) >> 8;
+    const uint8_t blue  = (color & 0x0000FF);
+    withFormat(o, [&](auto format){
+        typedef decltype(format) F;
+        constexpr uint32_t BPP = F::bpp;
         for( uint32_t j = 0; j < thickness && y+j < o.height(); ++j ){
-            o.r(x+i,y+j) = (color & 0xFF0000) >> 16;
-            o.g(x+i,y+j) = (color & 0x00FF00) >> 8;
-            o.b(x+i,y+j) = (color & 0x0000FF);
+            auto row = o.row<BPP>(y+j);
+            for( uint32_t i = 0; i < thickness && x+i < o.width(); ++i){
+                uint8_t* pixel = row[x+i];
+                pixel[F::r] = red;
+                pixel[F::g] = green;
+                pixel[F::b] = blue;
+            }
         }
-    }
+    });
 }
 
 void drawLine(Bitmap & o, const pt & p1, const pt & p2, uint32_t color, uint32_t thickness){
@@ -869,88 +1018,15 @@ void drawLine(Bitmap & o, const pt & p1, const pt & p2, uint32_t color, uint32_t
 	}
 }
 
+/*
+ * Grayscale and threshold in one pass. Alpha is thresholded along with the colors and
+ * the row padding is left alone.
+ */
 void binaryGray(Bitmap &o, const int32_t isovalue){
-    grayscale(o);
-    transform(o.getBits().begin(), o.getBits().end(),o.getBits().begin(),
-              [&isovalue](auto value){return value > isovalue ? 255 : 0;});
-}
-
-/*
- * The idea here is to return a set of a pair of edges. Why this isn't just a pair of
- * edges is due to the ambiguous case where there are two possible pairs of edges.
- * We'll define an edge as two vertices, (v,v')
- *
- * We want to map from the unit square to the square at (i,j), but our table will only
- * return the unit square edges, we'll do the mapping after calling edges.
- */
-vector<pair<edge,edge>> edges( uint8_t square ){
-    vector<pair<edge,edge>> sides;
-    switch( square ){
-    case 1:                                             /* ********************/
-    case 14:                                            // Bottom, Left       */
-        sides = { make_pair( edge( pt(0,0),pt(0,1) ),   // +==+               */
-                             edge( pt(0,0),pt(1,0) )    // |  |               */
-                           )                            // -==+               */
-                };                                      /* ********************/
-        break;
-
-    case 2:                                             /* ********************/
-    case 13:                                            //  Bottom, Right     */
-        sides = { make_pair( edge( pt(0,0),pt(1,0) ),   // +==+               */
-                             edge( pt(1,0),pt(1,1) )    // |  |               */
-                           )                            // +==-               */
-                };                                      /* ********************/
-        break;
-
-    case 3:                                             /* ********************/
-    case 12:                                            // Left, Right        */
-        sides = { make_pair( edge( pt(0,0),pt(0,1) ),   // +==+               */
-                             edge( pt(1,0),pt(1,1) )    // |  |               */
-                           )                            // -==-               */
-                };                                      /* ********************/
-        break;
-
-    case 4:                                             /* ********************/
-    case 11:                                            // Top, Right         */
-        sides = { make_pair( edge( pt(0,1),pt(1,1) ),   // +==-               */
-                             edge( pt(1,0),pt(1,1) )    // |  |               */
-                           )                            // +==+               */
-                };                                      /* ********************/
-        break;
-
-    case 5:                                             /* ******************************/
-    case 10:                                            // {Top, Right}, {Bottom, Left} */
-        sides = { make_pair( edge( pt(0,1),pt(1,1) ),   // -==+                         */
-                             edge( pt(1,1),pt(1,0) )    // |  |                         */
-                           ),                           // +==-                         */
-                  make_pair( edge( pt(0,0),pt(0,1) ),   /* ******************************/
-                             edge( pt(0,0),pt(1,0) )
-                           )
-                };
-        break;
-
-    case 6:                                             /* ********************/
-    case 9:                                             // {Top, Bottom}      */
-        sides = { make_pair( edge( pt(0,1),pt(1,1) ),   // +==-               */
-                             edge( pt(0,0),pt(1,0) )    // |  |               */
-                           )                            // +==-               */
-                };                                      /* ********************/
-        break;
-
-    case 7:                                             /* ********************/
-    case 8:                                             // {Top, Left}        */
-        sides = { make_pair( edge( pt(0,1),pt(1,1) ),   // +==-               */
-                             edge( pt(0,0),pt(0,1) )    // |  |               */
-                           )                            // -==-               */
-                };                                      /* *********************/
-        break;
-    /* **********************
-     * None
-     ***********************/
-    case 0:
-    case 15:
-    default:
-        break;
-    }
-    return sides;
+    const int32_t w = o.width();
+    withFormat(o, [&](auto format){
+        constexpr PointLayout layout = pointLayout<decltype(format)>();
+        forEachRow(o, [&](uint8_t* row){ binaryGrayRow(row, w, layout, isovalue); });
+    });
 }
+
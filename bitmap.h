@@ -7,6 +7,10 @@
 #include <cmath>
 #include "point.hpp"
 #include "BitmapIterator.h"
+#include "MappedFile.h"
+#include "BufferPool.h"
+#include "PixelFormat.h"
+#include "PointOps.h"
 /*
 Tasks to do:
 1. Create a Pixel class to hold the argb pixel information, this should be simple
@@ -25,11 +29,26 @@ using namespace std;
 
 const int32_t ISOVALUE = 57;
 const int32_t STEPSIZE = 5;
+
+// How the pixel data of a file is brought into a Bitmap
+enum class LoadMode{
+    Stream,     // Read through an istream into memory owned by the Bitmap
+    Mapped      // Read straight out of a memory mapping, copied on the first write
+};
+
+// Whether a filter may spread its work over several threads
+enum class Execution{
+    Serial,
+    Parallel
+};
+
 class Bitmap
 {
 private:
     friend istream& operator>>(istream& in, Bitmap& b);
     friend ostream& operator<<(ostream& out, const Bitmap& b);
+    friend class BitmapReader;
+    friend class BitmapWriter;
     // Bitmap file format header:
 
     // 14 bytes wide
@@ -118,7 +137,12 @@ private:
     uint32_t _bpp      = 0;  // Bytes per pixel
 
     // This is where we store everything
-    vector<uint8_t>  _bits;
+    PixelBuffer      _bits;
+
+    // When loaded with LoadMode::Mapped the pixels are read from the file mapping
+    // instead of _bits. Copies share the mapping, the first write detaches.
+    shared_ptr<const MappedFile> _mapping;
+    const uint8_t*   _mapped = nullptr;
 
     // Helper private functions
     // Uses info in colorspace to init masks
@@ -127,6 +151,27 @@ private:
     // Returns the position in the mask where a mask is a disjoint set of bitshifted 0xFF values
     uint32_t maskToInt( uint32_t )noexcept;
 
+    // Sets masks, bytes per pixel and row sizes from the headers
+    void initLayout();
+
+    // Reads the headers out of the first size bytes of a file and sets up the layout,
+    // the one place files are checked, for streams and mappings alike
+    void parseHeaders( const uint8_t* file, size_t size );
+
+    // Header only halves of the stream operators
+    void readHeaders( istream& in );
+    void writeHeaders( ostream& out ) const;
+
+    // Like setDimension, but leaves the pixels alone
+    void setHeaderDimension( int32_t width, int32_t height );
+
+    // Zeroes the row padding after the layout changes
+    void clearPadding();
+
+    // Copies the pixels out of the file mapping into _bits so they can be written to
+    void detach(){ if( _mapped ) _detach(); }
+    void _detach();
+
     // Returns single pixel/color
     uint8_t& getPixel( int x, int y, uint32_t mask );
     const uint8_t& getPixel( int x, int y, uint32_t mask )const;
@@ -168,11 +213,46 @@ public:
     uint32_t bmask() const{ return b_mask; }
     uint32_t amask() const{ return a_mask; }
     bool     hasAlpha() const{ return dibs.cmpsn; }
+    // Rows are stored bottom up, the first one in memory is the bottom of the picture
+    bool     bottomUp() const{ return dibs.height > 0; }
     uint32_t padding(){return _rowWidth-_rowSize;}
 
-    auto& getBits(){return _bits;}
-    const auto& getBits()const{return _bits;}
-    auto bpp(){ return _bpp;}
+    // Mutable access to the pixels always goes through _bits
+    auto& getBits(){ detach(); return _bits;}
+    // Read only access, valid for both owned and mapped pixels
+    const uint8_t* data()const{ return _mapped ? _mapped : _bits.data(); }
+    size_t   rawSize()const{ return _mapped ? dibs.rawSize : _bits.size(); }
+    bool     isMapped()const{ return _mapped != nullptr; }
+    uint32_t bpp() const{ return _bpp;}
+
+    /*!
+     * \brief row gives unchecked access to a whole row of pixels, the orientation of the
+     *        image is taken care of here so y = 0 is always the first row, as with r(x,y)
+     * \param y the row, only checked in debug builds
+     */
+    template<uint32_t BPP>
+    PixelRow<uint8_t, BPP> row( int32_t y ){
+        assert( BPP == _bpp );
+        detach();
+        return PixelRow<uint8_t, BPP>( _bits.data() + rowOffset(y), dibs.width );
+    }
+    template<uint32_t BPP>
+    PixelRow<const uint8_t, BPP> row( int32_t y ) const{
+        assert( BPP == _bpp );
+        return PixelRow<const uint8_t, BPP>( data() + rowOffset(y), dibs.width );
+    }
+    // Byte offset of row y in the pixel data
+    size_t rowOffset( int32_t y ) const{
+        assert( y >= 0 && y < height() );
+        return size_t( dibs.height < 0 ? -dibs.height - 1 - y : y ) * _rowWidth;
+    }
+
+    /*!
+     * \brief mapFile loads the bitmap by mapping the file into memory, no pixels are
+     *        copied until the first write to this bitmap or one of its copies.
+     * \param filename the bmp to map
+     */
+    void mapFile( const string& filename );
     // This function sets the internal dimensions of the bitmap, and in doing so
     // it takes no regards for the image that was in it and should be considered
     // corrucpted.
@@ -186,15 +266,37 @@ public:
     typedef uint8_t&                                reference;
     typedef size_t                                  size_type;
     typedef ptrdiff_t                               difference_type;
-    typedef std::bidirectional_iterator_tag         iterator_category;
+    typedef std::random_access_iterator_tag         iterator_category;
     typedef BitmapIterator                          iterator;
-    typedef BitmapIterator                          const_iterator;
+    typedef ConstBitmapIterator                     const_iterator;
+    typedef RowIterator                             row_iterator;
+    typedef ConstRowIterator                        const_row_iterator;
+
+    // Pixel iterators, one step per pixel in r(x,y) order with the padding skipped.
+    // The mutable ones detach a mapped bitmap.
+    iterator begin(){ detach(); return iterator(_bits.data() + firstRow(), rowStride(), width(), _bpp); }
+    iterator end(){ return begin() + pixelCount(); }
+    const_iterator begin() const{ return const_iterator(data() + firstRow(), rowStride(), width(), _bpp); }
+    const_iterator end() const{ return begin() + pixelCount(); }
+    const_iterator cbegin() const{ return begin(); }
+    const_iterator cend() const{ return end(); }
+
+    // Row iterators in row(y) order, for handing whole rows to a parallel algorithm
+    RowRange<row_iterator> rows(){
+        detach();
+        row_iterator first( _bits.data() + firstRow(), rowStride() );
+        return { first, first + height() };
+    }
+    RowRange<const_row_iterator> rows() const{
+        const_row_iterator first( data() + firstRow(), rowStride() );
+        return { first, first + height() };
+    }
 
-    // Iterators
-    iterator begin(){return iterator(this);}
-    iterator end(){return iterator(this,true);}
-    iterator cbegin(){return iterator(this);}
-    iterator cend(){return iterator(this,true);}
+private:
+    // Where row 0 starts and how far apart rows are, top down images run backwards
+    size_t    firstRow() const{ return dibs.height < 0 ? size_t(height() - 1) * _rowWidth : 0; }
+    ptrdiff_t rowStride() const{ return dibs.height < 0 ? -ptrdiff_t(_rowWidth) : ptrdiff_t(_rowWidth); }
+    ptrdiff_t pixelCount() const{ return ptrdiff_t(width()) * height(); }
 };
 class BadFileTypeException: public exception{
     inline const char * what() const noexcept{
@@ -226,22 +328,99 @@ class InvalidWidthException: public exception{
     }
 };
 
+class InvalidRadiusException: public exception{
+    inline const char * what() const noexcept{
+        return "Blur radius must be between 1 and 6";
+    }
+};
+
+class InvalidBlockSizeException: public exception{
+    inline const char * what() const noexcept{
+        return "Block size must be at least 1";
+    }
+};
+
+class FileOpenException: public exception{
+    inline const char * what() const noexcept{
+        return "Could not open file";
+    }
+};
+
+class TruncatedFileException: public exception{
+    inline const char * what() const noexcept{
+        return "File is smaller than its header claims";
+    }
+};
+
+/*!
+ * \brief loadBitmap reads a bmp from disk
+ * \param b the bitmap to load into, left untouched if loading throws
+ * \param filename the bmp to read
+ * \param mode LoadMode::Mapped avoids copying the pixels until they are written to
+ */
+void loadBitmap(Bitmap& b, const string& filename, LoadMode mode = LoadMode::Stream);
+
+/*!
+ * \brief withFormat calls f with the PixelFormat of b, pick the format once per image
+ *        and let the filter run with constant offsets
+ * \throws BadMaskOrderException if the masks of b do not describe a pixel
+ */
+template<typename F>
+void withFormat(const Bitmap& b, F&& f){
+    if( !withFormat(b.bpp(), b.rmask(), b.gmask(), b.bmask(), f) )
+        throw BadMaskOrderException();
+}
+
+// Blur reach in pixels each way, the default of 2 is the 5x5 kernel
+const int32_t BLURRADIUS    = 2;
+// Largest radius whose sums still fit in 32 bits
+const int32_t MAXBLURRADIUS = 6;
+
+// Default side of a pixelate block
+const int32_t PIXELATEBLOCK = 16;
+
 // Filter Functions
-void cellShade(Bitmap& b)noexcept;
+void cellShade(Bitmap& b);
 void grayscale(Bitmap& b);
-void pixelate(Bitmap& b);
-void blur(Bitmap& b);
-void rot90(Bitmap& b);
+// Runs a chain of point filters over the image in one pass
+void pointChain(Bitmap& b, const PointChain& chain);
+/*!
+ * \brief pixelate sets each block x block square, counted from row(0) and x = 0, to
+ *        the average color of its pixels rounded down, alpha is left alone
+ * \throws InvalidBlockSizeException if block is less than 1
+ */
+void pixelate(Bitmap& b, int32_t block = PIXELATEBLOCK, Execution exec = Execution::Parallel);
+/*!
+ * \brief blur applies a binomial (Gaussian) blur to the colors, alpha is left alone.
+ *        With weights w = row 2r of Pascal's triangle each color becomes
+ *        floor( sum of w[i]*w[j]*p(x+i-r, y+j-r) / 2^(4r) ), edge pixels repeated
+ *        past the border. r = 2 is the 5x5 kernel [1 4 6 4 1]^T [1 4 6 4 1] / 256.
+ * \param radius r, from 1 up to MAXBLURRADIUS
+ * \throws InvalidRadiusException for any other radius
+ */
+void blur(Bitmap& b, int32_t radius = BLURRADIUS, Execution exec = Execution::Parallel);
+void rot90(Bitmap& b, Execution exec = Execution::Parallel);
 void rot180(Bitmap& b);
-void rot270(Bitmap& b);
+void rot270(Bitmap& b, Execution exec = Execution::Parallel);
 void flipv(Bitmap& b);
 void fliph(Bitmap& b)noexcept;
-void flipd1(Bitmap& b);
-void flipd2(Bitmap& b);
+void flipd1(Bitmap& b, Execution exec = Execution::Parallel);
+void flipd2(Bitmap& b, Execution exec = Execution::Parallel);
 void scaleUp(Bitmap& b);
 void scaleDown(Bitmap& b);
+/*!
+ * \brief boxShrink shrinks the image by factor both ways, each pixel the average of the
+ *        block it stands for, partial blocks at the right and bottom edges included
+ * \param factor from 1 up, 1 gives a copy
+ */
+void boxShrink(const Bitmap& from, Bitmap& to, int32_t factor, Execution exec = Execution::Parallel);
+void boxShrink(Bitmap& b, int32_t factor, Execution exec = Execution::Parallel);
 
 void contours(Bitmap& b, int32_t isovalues=ISOVALUE, int32_t stepsize=STEPSIZE, bool useBinaryBitmap = true);
+// Convex hulls of the contours with more than three points, the ones contours() draws
+vector<vector<pt>> contourHulls(const vector<vector<pt>>& cont);
+// Draws hulls and the points of cont itself onto b, the second half of contours()
+void drawContours(Bitmap& b, const vector<vector<pt>>& cont, const vector<vector<pt>>& hulls);
 
 // Final Functions
 
@@ -255,16 +434,20 @@ void binaryGray( Bitmap &image, const int32_t isovalue);
  * \brief findContours returns a vector of vectors of points, that is to say that
  *        each vector is a set of points that should form a completed contour
  * \param o
+ * \param exec Parallel thresholds and traces bands of rows on the thread pool, the
+ *        contours are the same either way
  * \return vector of sets of points that create a completed contour shape
  */
-vector<vector<pt>> findContours(const Bitmap& o, int32_t isovalue, uint32_t step, bool useBinaryInterp);
+vector<vector<pt>> findContours(const Bitmap& o, int32_t isovalue, uint32_t step, bool useBinaryInterp,
+                                Execution exec = Execution::Parallel);
 /*!
- * \brief edges lookup table for 2^4 edge possibilities
- * \param square a binary value with positions 0,1,2,3 being the corners of a square from
- * the marching squares algorithm. lb, rb, rt, lt with lt being the most significant.
- * \return a vector of edge pairs from the table
+ * \brief findContours for several isovalues at once, the luminance is worked out once
+ *        and the cells swept once for all of them
+ * \param isovalues levels to trace, 0 to 255 for the whole stack
+ * \return for each isovalue the contours findContours gives for it alone
  */
-vector<pair<edge,edge>> edges( uint8_t square );
+vector<vector<vector<pt>>> findContours(const Bitmap& o, const vector<int32_t>& isovalues, uint32_t step,
+                                        bool useBinaryInterp, Execution exec = Execution::Parallel);
 /*!
  * \brief composeBits
  * \param b the previous corner
@@ -1,9 +1,21 @@
 #include "MainWindow.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include "ThreadPool.h"
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+
+    // -j N runs the filters on N threads, one per core when not given
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption threads({"j", "threads"}, QObject::tr("Threads the filters run on."), QObject::tr("count"));
+    parser.addOption(threads);
+    parser.process(a);
+    if(parser.isSet(threads))
+        ThreadPool::instance().setThreadCount(parser.value(threads).toUInt());
+
     MainWindow w;
     w.show();
 